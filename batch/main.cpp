@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "nicogb.hpp"
+#include "pool.hpp"
+
+// nicogb-batch [-j threads] [-o report.jsonl] manifest
+//
+// Every manifest line is a job: a ROM path followed by optional settings,
+//     roms/tetris.gb frames=3600 input=scripts/start.txt
+//     roms/cpu_instrs.gb cycles=300000000
+// A job stops at the first budget it reaches, checked once per frame, and
+// runs 600 frames when it has none. state= starts from a save state instead of
+// power on, to skip long intros, and save= writes one when the job ends.
+// render=N draws only every Nth frame, render=0 none, for jobs that only need
+// memory and serial output. The last frame is always drawn for the hash.
+// Blank lines and lines starting with # are skipped.
+//
+// An input script holds one key event per line, applied before the given frame,
+//     120 down START
+//     126 up START
+
+typedef std::chrono::steady_clock Clock;
+
+struct Input {
+    uint64_t frame;
+    bool down;
+    Key key;
+};
+
+struct Job {
+    std::string rom;
+    std::string script;
+    std::string state;
+    std::string save;
+    uint64_t frames = UINT64_MAX;
+    uint64_t cycles = UINT64_MAX;
+    unsigned render = 1;
+    std::vector<Input> inputs;
+    std::string error;
+};
+
+Key getKey(const std::string& name) {
+    const char* NAMES[] = {"RIGHT", "LEFT", "UP", "DOWN", "A", "B", "SELECT", "START"};
+    for (int key = RIGHT; key < NONE; ++key) {
+        if (name == NAMES[key]) return Key(key);
+    }
+    return NONE;
+}
+
+bool parseInputs(Job& job) {
+    std::ifstream file(job.script);
+    if (!file) {
+        job.error = "input script not found";
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        Input input;
+        std::string action;
+        std::string key;
+        if (line.empty() || line[0] == '#') continue;
+        if (!(fields >> input.frame >> action >> key) || (action != "down" && action != "up")
+            || (input.key = getKey(key)) == NONE) {
+            job.error = "bad input line: " + line;
+            return false;
+        }
+        input.down = action == "down";
+        job.inputs.push_back(input);
+    }
+    std::stable_sort(job.inputs.begin(), job.inputs.end(),
+        [](const Input& a, const Input& b) { return a.frame < b.frame; });
+    return true;
+}
+
+bool parseManifest(const char* path, std::vector<Job>& jobs) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "%s: not found\n", path);
+        return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        std::istringstream fields(line);
+        std::string field;
+        Job job;
+        if (!(fields >> job.rom) || job.rom[0] == '#') continue;
+        while (fields >> field) {
+            size_t equals = field.find('=');
+            std::string name = field.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+            char* end = nullptr;
+            if (name == "frames" || name == "cycles" || name == "render") {
+                uint64_t n = strtoull(value.c_str(), &end, 10);
+                if (value.empty() || *end) {
+                    fprintf(stderr, "%s:%d: bad number %s\n", path, number, field.c_str());
+                    return false;
+                }
+                if (name == "render") {
+                    job.render = n;
+                } else {
+                    (name == "frames" ? job.frames : job.cycles) = n;
+                }
+            } else if (name == "input") {
+                job.script = value;
+            } else if (name == "state") {
+                job.state = value;
+            } else if (name == "save") {
+                job.save = value;
+            } else {
+                fprintf(stderr, "%s:%d: unknown setting %s\n", path, number, field.c_str());
+                return false;
+            }
+        }
+        if (job.frames == UINT64_MAX && job.cycles == UINT64_MAX) {
+            job.frames = 600;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// FNV-1a over the final framebuffer, enough to tell screens apart in a regression
+uint64_t hash(const std::vector<uint32_t>& framebuffer) {
+    uint64_t h = 0xCBF29CE484222325;
+    for (uint32_t pixel : framebuffer) {
+        for (int i = 0; i < 4; ++i) {
+            h = (h ^ ((pixel >> (i * 8)) & 0xFF)) * 0x100000001B3;
+        }
+    }
+    return h;
+}
+
+// Serial output is raw bytes, anything outside printable ASCII is escaped
+std::string quote(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c < 0x20 || c >= 0x7F) {
+            char escape[7];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+struct Totals {
+    std::mutex mutex;
+    FILE* report;
+    uint64_t frames = 0;
+    uint64_t failed = 0;
+};
+
+void run(size_t index, Job& job, Totals& totals) {
+    NicoGB nicogb;
+    uint64_t frame = 0;
+    auto start = Clock::now();
+
+    if (job.error.empty() && (job.script.empty() || parseInputs(job))) {
+        nicogb.load(job.rom, false);
+        if (!nicogb.loaded) {
+            job.error = "rom not found";
+        }
+    }
+    if (job.error.empty() && !job.state.empty()) {
+        std::ifstream file(job.state, std::ifstream::binary);
+        std::vector<uint8_t> state((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file || !nicogb.loadState(state)) {
+            job.error = "bad state " + job.state;
+        }
+    }
+    if (job.error.empty()) {
+        auto input = job.inputs.begin();
+        nicogb.renderEvery(job.render);
+        while (frame < job.frames && nicogb.cycles() < job.cycles) {
+            for (; input != job.inputs.end() && input->frame <= frame; ++input) {
+                input->down ? nicogb.keyDown(input->key) : nicogb.keyUp(input->key);
+            }
+            if (frame + 1 == job.frames || nicogb.cycles() + NicoGB::FRAME >= job.cycles) {
+                nicogb.renderFrame();
+            }
+            nicogb.runFrame();
+            ++frame;
+        }
+    }
+    if (job.error.empty() && !job.save.empty()) {
+        std::vector<uint8_t> state;
+        nicogb.saveState(state, true);
+        std::ofstream file(job.save, std::ofstream::binary);
+        if (!file.write((const char*) state.data(), state.size())) {
+            job.error = "cannot write " + job.save;
+        }
+    }
+    double wall = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(totals.mutex);
+    if (job.error.empty()) {
+        fprintf(totals.report,
+            "{\"job\":%zu,\"rom\":%s,\"frames\":%llu,\"cycles\":%llu,\"wall\":%.6f,"
+            "\"hash\":\"%016llx\",\"serial\":%s}\n",
+            index, quote(job.rom).c_str(), (unsigned long long) frame,
+            (unsigned long long) nicogb.cycles(), wall,
+            (unsigned long long) hash(nicogb.framebuffer), quote(nicogb.serial).c_str());
+    } else {
+        fprintf(totals.report, "{\"job\":%zu,\"rom\":%s,\"error\":%s}\n",
+            index, quote(job.rom).c_str(), quote(job.error).c_str());
+        ++totals.failed;
+    }
+    totals.frames += frame;
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = std::thread::hardware_concurrency();
+    const char* output = nullptr;
+    const char* manifest = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!manifest && argv[i][0] != '-') {
+            manifest = argv[i];
+        } else {
+            manifest = nullptr;
+            break;
+        }
+    }
+    if (!manifest) {
+        fprintf(stderr, "usage: %s [-j threads] [-o report.jsonl] manifest\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Job> jobs;
+    if (!parseManifest(manifest, jobs)) return 2;
+
+    Totals totals;
+    totals.report = output ? fopen(output, "w") : stdout;
+    if (!totals.report) {
+        fprintf(stderr, "%s: cannot write\n", output);
+        return 2;
+    }
+
+    auto start = Clock::now();
+    {
+        Pool pool(threads);
+        threads = pool.threads();
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool.submit([&, i] { run(i, jobs[i], totals); });
+        }
+        pool.wait();
+    }
+    double wall = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (output) fclose(totals.report);
+    fprintf(stderr, "%zu jobs, %u threads, %llu frames in %.2f s, %.0f frames/s\n",
+        jobs.size(), threads, (unsigned long long) totals.frames, wall,
+        wall > 0 ? totals.frames / wall : 0.0);
+    return totals.failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include "pool.hpp"
+
+Pool::Pool(unsigned threads) :
+    queues(threads ? threads : 1) {
+        next = 0;
+        queued = 0;
+        pending = 0;
+        stop = false;
+        for (unsigned i = 0; i < queues.size(); ++i) {
+            workers.emplace_back(&Pool::work, this, i);
+        }
+}
+
+Pool::~Pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned Pool::threads() {
+    return queues.size();
+}
+
+// Jobs are dealt round-robin, stealing evens out whatever the deal got wrong
+void Pool::submit(std::function<void()> job) {
+    Queue& queue = queues[next++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++queued;
+        ++pending;
+    }
+    wake.notify_one();
+}
+
+void Pool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+bool Pool::pop(unsigned self, std::function<void()>& job) {
+    for (unsigned i = 0; i < queues.size(); ++i) {
+        Queue& queue = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        } else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void Pool::work(unsigned self) {
+    std::function<void()> job;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stop || queued > 0; });
+            if (queued == 0) {
+                return;
+            }
+            // Claim a job; it is in some queue, even if another worker moves first
+            --queued;
+        }
+        while (!pop(self, job)) {
+            std::this_thread::yield();
+        }
+        job();
+        job = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                done.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque, takes its newest job
+// from the back and, once empty, steals the oldest job from the front of the others.
+class Pool {
+    public:
+        unsigned threads();
+        void submit(std::function<void()> job);
+        void wait();
+        Pool(unsigned threads);
+        ~Pool();
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> jobs;
+        };
+
+        std::vector<Queue> queues;
+        std::vector<std::thread> workers;
+        std::atomic<unsigned> next;
+
+        // Jobs sitting in a queue and jobs not yet finished
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        size_t queued;
+        size_t pending;
+        bool stop;
+
+        bool pop(unsigned self, std::function<void()>& job);
+        void work(unsigned self);
+};
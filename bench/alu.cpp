@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../src/nicogb.hpp"
+
+// ALU throughput of the CPU as built, the eager flag helpers in cpu.cpp or the
+// ALU tables with ALU_TABLES. A ROM of ADC, SBC, RL and DAA loops with the LCD
+// off, every operation depending on the previous A and F like real decompression
+// loops. make bench runs it built both ways, the second run compares with the first
+// and fails unless both left the same registers behind.
+//     NicoGB-bench [results of the other build]
+
+typedef std::chrono::steady_clock Clock;
+
+const char* ROM = "NicoGB-bench.gb";
+const uint16_t ENTRY = 0x150;
+const uint16_t END = 0x7FF0;
+
+// Returns the M-cycles of one pass through the loop
+uint64_t build(std::vector<uint8_t>& rom, unsigned& ops) {
+    rom.assign(0x8000, 0);
+    uint16_t pc = ENTRY;
+    auto emit = [&](uint8_t b) { rom[pc++] = b; };
+    emit(0xF3);                         // DI
+    emit(0xAF);                         // XOR A
+    emit(0xE0); emit(0x40);             // LDH (LCDC),A
+    uint16_t loop = pc;
+    uint64_t cycles = 0;
+    uint32_t seed = 1;
+    ops = 0;
+    while (pc < END) {
+        seed = seed * 1664525 + 1013904223;
+        uint8_t n = seed >> 16;
+        switch ((seed >> 24) & 0x3) {
+            case 0: emit(0xCE); emit(n); cycles += 2; break; // ADC A,n
+            case 1: emit(0xDE); emit(n); cycles += 2; break; // SBC A,n
+            case 2: emit(0xCB); emit(0x17); cycles += 2; break; // RL A
+            case 3: emit(0x27); cycles += 1; break;          // DAA
+        }
+        ++ops;
+    }
+    emit(0xC3); emit(loop & 0xFF); emit(loop >> 8); // JP loop
+    cycles += 4;
+
+    rom[0x100] = 0x00;
+    rom[0x101] = 0xC3; rom[0x102] = ENTRY & 0xFF; rom[0x103] = ENTRY >> 8;
+    const char* title = "ALU BENCH";
+    for (int i = 0; title[i]; ++i) rom[0x134 + i] = title[i];
+    int x = 0x19;
+    for (int i = 0x134; i < 0x14D; ++i) x += rom[i];
+    rom[0x14D] = -x;
+    return cycles;
+}
+
+int main(int argc, char** argv) {
+#ifdef ALU_TABLES
+    const char* name = "tables";
+#else
+    const char* name = "helpers";
+#endif
+    std::vector<uint8_t> rom;
+    unsigned ops;
+    uint64_t pass = build(rom, ops) * 4;
+    FILE* f = fopen(ROM, "wb");
+    if (!f || fwrite(rom.data(), 1, rom.size(), f) != rom.size()) {
+        fprintf(stderr, "%s: can't write\n", ROM);
+        return 2;
+    }
+    fclose(f);
+
+    NicoGB nicogb;
+    nicogb.load(ROM, false);
+    remove(ROM);
+    nicogb.renderEvery(0);
+    // Through the boot ROM into the loop, one instruction at a time
+    while (nicogb.registers().PC < ENTRY + 4) {
+        nicogb.runCycles(1);
+    }
+
+    // FNV-1a over the registers after every pass
+    const int PASSES = 2000;
+    uint64_t h = 0xCBF29CE484222325;
+    auto start = Clock::now();
+    for (int i = 0; i < PASSES; ++i) {
+        nicogb.runCycles(pass);
+        h = (h ^ nicogb.registers().AF) * 0x100000001B3;
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ((double) PASSES * ops);
+
+    if (argc < 2) {
+        printf("%s %.3f %016llx\n", name, ns, (unsigned long long) h);
+        return 0;
+    }
+    char other[16];
+    double otherNs;
+    unsigned long long otherHash;
+    f = fopen(argv[1], "r");
+    if (!f || fscanf(f, "%15s %lf %llx", other, &otherNs, &otherHash) != 3) {
+        fprintf(stderr, "%s: no results\n", argv[1]);
+        return 2;
+    }
+    fclose(f);
+    printf("%-8s %.2f ns/op\n", (std::string(other) + ":").c_str(), otherNs);
+    printf("%-8s %.2f ns/op\n", (std::string(name) + ":").c_str(), ns);
+    printf("speedup: %.2fx\n", otherNs / ns);
+    if (h != otherHash) {
+        printf("mismatch: %016llx != %016llx\n", (unsigned long long) h, otherHash);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "../src/nicogb.hpp"
+
+// What a fork costs, in time and in heap of its own, with the forks taken at
+// points all over the frame of a ROM that keeps writing WRAM. Fails if any fork
+// allocates more than LIMIT bytes, everything else is shared until written.
+//     NicoGB-fork-bench
+
+typedef std::chrono::steady_clock Clock;
+
+const char* ROM = "NicoGB-fork-bench.gb";
+const size_t LIMIT = 24 * 1024;
+const int FORKS = 1000;
+
+// Bytes allocated while counting is on
+bool counting = false;
+size_t allocated = 0;
+
+void* operator new(size_t size) {
+    if (counting) allocated += size;
+    if (void* p = malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void build(std::vector<uint8_t>& rom) {
+    const uint8_t code[] = {
+        0x21, 0x00, 0xC0, // LD HL,0xC000
+        0x3C,             // INC A
+        0x22,             // LD (HL+),A
+        0xCB, 0x6C,       // BIT 5,H
+        0x28, 0xFA,       // JR Z,INC A, until HL reaches 0xE000
+        0x18, 0xF5,       // JR LD HL
+    };
+    rom.assign(0x8000, 0);
+    std::copy(code, code + sizeof(code), rom.begin() + 0x150);
+    rom[0x100] = 0x00;
+    rom[0x101] = 0xC3; rom[0x102] = 0x50; rom[0x103] = 0x01; // JP 0x150
+    const char* title = "FORK BENCH";
+    for (int i = 0; title[i]; ++i) rom[0x134 + i] = title[i];
+    int x = 0x19;
+    for (int i = 0x134; i < 0x14D; ++i) x += rom[i];
+    rom[0x14D] = -x;
+}
+
+int main() {
+    std::vector<uint8_t> rom;
+    build(rom);
+    FILE* f = fopen(ROM, "wb");
+    if (!f || fwrite(rom.data(), 1, rom.size(), f) != rom.size()) {
+        fprintf(stderr, "%s: can't write\n", ROM);
+        return 2;
+    }
+    fclose(f);
+
+    NicoGB nicogb;
+    nicogb.load(ROM, false);
+    remove(ROM);
+    // Past the boot ROM, with the logo on screen
+    for (int frame = 0; frame < 400; ++frame) {
+        nicogb.runFrame();
+    }
+
+    size_t most = 0;
+    size_t total = 0;
+    double us = 0;
+    for (int i = 0; i < FORKS; ++i) {
+        nicogb.runCycles(1 + (i * 7919) % NicoGB::FRAME);
+        allocated = 0;
+        counting = true;
+        auto start = Clock::now();
+        std::unique_ptr<NicoGB> child = nicogb.fork();
+        us += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        counting = false;
+        most = std::max(most, allocated);
+        total += allocated;
+        // Whatever the fork draws matches the original, and two frames on it has
+        // drawn one whole
+        for (int frame = 0; frame < 2; ++frame) {
+            child->runFrame();
+            nicogb.runFrame();
+            bool drawn = frame == 1 || !child->framebuffer.empty();
+            if ((drawn && child->framebuffer != nicogb.framebuffer) || child->registers().PC != nicogb.registers().PC) {
+                printf("fork %d differs\n", i);
+                return 1;
+            }
+        }
+    }
+    printf("fork: %.1f us, %zu bytes on average, %zu at most (limit %zu)\n",
+        us / FORKS, total / FORKS, most, LIMIT);
+    return most > LIMIT;
+}
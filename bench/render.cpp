@@ -0,0 +1,147 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../src/scheduler.hpp"
+#include "../src/timer.hpp"
+#include "../src/cartridge.hpp"
+#include "../src/joypad.hpp"
+#include "../src/memory.hpp"
+#include "../src/ppu.hpp"
+#include "../src/cpu.hpp"
+#include "../src/state.hpp"
+#include "../src/compositor.hpp"
+
+// Scanline rendering at each compositor level this CPU supports, the scalar one
+// being the plain per-pixel loops. A ROM runs once per level while its frames are
+// hashed, all levels must draw the same. Every 30 frames VRAM, OAM and the LCD
+// registers are dumped as the frame starts, and those dumps are drawn again and
+// again for the timings.
+//     NicoGB-render-bench rom.gb [frames]
+
+typedef std::chrono::steady_clock Clock;
+
+const char* NAMES[] = {"scalar", "sse2", "avx2"};
+
+struct Machine {
+    Scheduler scheduler;
+    Timer timer;
+    Cartridge cartridge;
+    Joypad joypad;
+    Memory memory;
+    PPU ppu;
+    CPU cpu;
+
+    Machine() :
+        timer(scheduler),
+        cartridge(scheduler),
+        memory(cartridge, joypad, timer, scheduler),
+        ppu(memory),
+        cpu(memory, ppu) {
+        memory.init();
+        ppu.init();
+    }
+
+    void runFrame() {
+        uint64_t end = scheduler.cycles + 70224;
+        ppu.frame = false;
+        while (!ppu.frame && scheduler.cycles < end) {
+            cpu.cycle(end);
+        }
+    }
+
+    // Into OAM search of line 0, before anything of the frame is drawn
+    void runToLine0() {
+        uint64_t end = scheduler.cycles + 70224;
+        while (!(memory.lcd.ly == 0 && (memory.lcd.stat & 0x3) == 2) && scheduler.cycles < end) {
+            cpu.cycle(end);
+        }
+    }
+
+    void dump(State& state, bool loading) {
+        state.start(loading);
+        memory.serialize(state);
+        ppu.serialize(state);
+    }
+};
+
+// FNV-1a over every frame the ROM shows, and the dumps taken along the way
+uint64_t record(const char* path, int frames, std::vector<State>& dumps) {
+    Machine machine;
+    uint64_t h = 0xCBF29CE484222325;
+    machine.memory.load(path, false);
+    if (!machine.cartridge.loaded) return 0;
+    dumps.clear();
+    for (int frame = 0; frame < frames; ++frame) {
+        machine.runFrame();
+        for (uint32_t pixel : machine.ppu.framebuffer) {
+            h = (h ^ pixel) * 0x100000001B3;
+        }
+        if (frame % 30 == 29) {
+            machine.runToLine0();
+            if (machine.memory.lcd.lcdc & 0x80) {
+                dumps.emplace_back();
+                machine.dump(dumps.back(), false);
+            }
+        }
+    }
+    return h;
+}
+
+// Microseconds per frame of 144 lines, loading a dump is not timed
+double draw(const char* path, std::vector<State>& dumps, int rounds) {
+    Machine machine;
+    machine.memory.load(path, false);
+    Clock::duration total = Clock::duration::zero();
+    for (int round = 0; round < rounds; ++round) {
+        for (State& dump : dumps) {
+            machine.dump(dump, true);
+            auto start = Clock::now();
+            for (int ly = 0; ly < 144; ++ly) {
+                machine.memory.lcd.ly = ly;
+                machine.ppu.drawLine();
+            }
+            total += Clock::now() - start;
+        }
+    }
+    return std::chrono::duration<double, std::micro>(total).count() / (rounds * dumps.size());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s rom.gb [frames]\n", argv[0]);
+        return 2;
+    }
+    int frames = argc > 2 ? atoi(argv[2]) : 3600;
+    Compositor::Level best = Compositor::level;
+
+    std::vector<State> dumps;
+    uint64_t scalarHash = 0;
+    double scalar = 0;
+    bool mismatch = false;
+    for (int level = Compositor::SCALAR; level <= best; ++level) {
+        Compositor::level = Compositor::Level(level);
+        uint64_t h = record(argv[1], frames, dumps);
+        if (h == 0) {
+            fprintf(stderr, "%s: not found\n", argv[1]);
+            return 2;
+        }
+        if (dumps.empty()) {
+            fprintf(stderr, "%s: the LCD never came on\n", argv[1]);
+            return 2;
+        }
+        double us = draw(argv[1], dumps, 20);
+        if (level == Compositor::SCALAR) {
+            scalarHash = h;
+            scalar = us;
+        }
+        printf("%-7s %.1f us/frame, %.2fx\n", NAMES[level], us, scalar / us);
+        if (h != scalarHash) {
+            printf("mismatch: %016llx != %016llx\n", (unsigned long long) h, (unsigned long long) scalarHash);
+            mismatch = true;
+        }
+    }
+    printf("%zu dumps from %d frames\n", dumps.size(), frames);
+    return mismatch ? 1 : 0;
+}
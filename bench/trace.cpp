@@ -0,0 +1,261 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../src/nicogb.hpp"
+
+// Differential test of the core variants. Generated ROMs of random instructions,
+// I/O, bank switches and jumps run in small budgets of cycles; the registers are
+// hashed after every budget and the whole machine, through a save state, every
+// CHECK budgets. make diff builds this with each variant and the
+// output must match the default build line for line. With cases only the
+// hand-made ROMs run, a frame at a time, for variants like the JIT that stop
+// only between blocks.
+//     NicoGB-trace [cases]
+
+const char* ROM = "NicoGB-trace.gb";
+const int SEEDS = 24;
+const long STEPS = 1000000;
+const long CHECK = 50000;
+const uint64_t BOOT = 333 * NicoGB::FRAME;
+
+struct Random {
+    uint64_t s;
+    uint32_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s >> 11;
+    }
+    uint32_t operator()(uint32_t n) { return next() % n; }
+};
+
+void header(std::vector<uint8_t>& rom, uint8_t type, uint8_t romSize, uint8_t ramSize) {
+    rom[0x100] = 0x00;
+    rom[0x101] = 0xC3; rom[0x102] = 0x50; rom[0x103] = 0x01; // JP 0x150
+    const char* title = "TRACE";
+    for (int i = 0; title[i]; ++i) rom[0x134 + i] = title[i];
+    rom[0x147] = type;
+    rom[0x148] = romSize;
+    rom[0x149] = ramSize;
+    int x = 0x19;
+    for (int i = 0x134; i < 0x14D; ++i) x += rom[i];
+    rom[0x14D] = -x;
+}
+
+// Weighted towards what the variants do differently: ALU and flag users, CB ops,
+// LCD and timer registers, MBC writes and control flow
+std::vector<uint8_t> generate(int seed) {
+    Random r{seed * 2654435761ull + 12345};
+    const uint8_t TYPES[] = {0x00, 0x01, 0x03, 0x06, 0x10, 0x13, 0x1B};
+    uint8_t type = TYPES[r(sizeof(TYPES))];
+    int banks = type == 0x00 ? 2 : 8;
+    std::vector<uint8_t> rom(banks * 0x4000);
+    const uint8_t IO[] = {0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0F, 0x40, 0x41, 0x42, 0x43,
+        0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0xFF, 0x80, 0x90};
+    const uint8_t ALU[] = {0x04, 0x05, 0x0C, 0x0D, 0x3C, 0x3D, 0x27, 0x2F, 0x37, 0x3F, 0x07,
+        0x0F, 0x17, 0x1F, 0x09, 0x19, 0x29, 0x39, 0x03, 0x0B, 0x23, 0x2B};
+    const uint8_t MEMORY[] = {0x77, 0x70, 0x71, 0x36, 0x22, 0x32, 0x7E, 0x46, 0x2A, 0x3A, 0x34, 0x35};
+    const uint8_t STACK[] = {0xC5, 0xD5, 0xE5, 0xF5, 0xC1, 0xD1, 0xE1, 0xF1};
+    const uint16_t POINTERS[] = {0x8000, 0x9800, 0xFE00, 0xC000, 0xA000, 0xFF80, 0xFF00, 0xE000};
+    const uint16_t MBC[] = {0x0000, 0x2000, 0x3000, 0x4000, 0x6000};
+
+    size_t pc = 0;
+    auto emit = [&](uint8_t b) { if (pc < rom.size()) rom[pc++] = b; };
+    auto target = [&]() { return 0x150 + r(0x7E00); };
+    while (pc < rom.size()) {
+        if (pc >= 0x100 && pc < 0x150) {
+            pc = 0x150;
+        } else if (pc >= 0x40 && pc <= 0x60 && pc % 8 == 0) {
+            // Interrupt handlers read a register, then return or jump somewhere
+            emit(0xF5); emit(0xF0); emit(IO[r(sizeof(IO))]); emit(0xF1);
+            if (r(2)) {
+                emit(0xD9);
+            } else {
+                uint16_t t = target();
+                emit(0xE1); emit(0xFB); emit(0xC3); emit(t & 0xFF); emit(t >> 8);
+            }
+        } else if (pc == 0x150) {
+            // IE, TAC and STAT, a stack in WRAM, maybe interrupts on
+            emit(0x3E); emit(r.next()); emit(0xE0); emit(0xFF);
+            emit(0x3E); emit(r.next()); emit(0xE0); emit(0x07);
+            emit(0x3E); emit(r.next() & 0x78); emit(0xE0); emit(0x41);
+            emit(0x31); emit(0xF0); emit(0xDF);
+            if (r(2)) emit(0xFB);
+        } else {
+            uint32_t kind = r(100);
+            if (kind < 18) {
+                emit(r(2) ? 0xE0 : 0xF0); emit(IO[r(sizeof(IO))]);
+            } else if (kind < 28) {
+                emit(0x3E); emit(r.next());
+            } else if (kind < 40) {
+                emit(0x80 + r(0x40));
+            } else if (kind < 46) {
+                emit(0xCB); emit(r.next());
+            } else if (kind < 50) {
+                emit(ALU[r(sizeof(ALU))]);
+            } else if (kind < 55) {
+                uint16_t address = POINTERS[r(8)] + r(0xA0);
+                emit(0x21); emit(address & 0xFF); emit(address >> 8);
+            } else if (kind < 62) {
+                uint8_t op = MEMORY[r(sizeof(MEMORY))];
+                emit(op);
+                if (op == 0x36) emit(r.next());
+            } else if (kind < 64) {
+                uint16_t address = MBC[r(5)] + r(0x100);
+                emit(0x3E); emit(r(3) == 0 ? 0x0A : r.next());
+                emit(0xEA); emit(address & 0xFF); emit(address >> 8);
+            } else if (kind < 68) {
+                // JR NZ/Z/NC/C, mostly forwards
+                emit(0x20 + 8 * r(4)); emit(r(5) == 0 ? -(int) r(20) - 3 : r(40));
+            } else if (kind < 70) {
+                uint16_t t = target();
+                emit(r(2) ? 0xC3 : 0xCD); emit(t & 0xFF); emit(t >> 8);
+            } else if (kind < 71) {
+                emit(0xC9 + r(2) * 0x10);
+            } else if (kind < 74) {
+                emit(STACK[r(8)]);
+            } else if (kind < 75) {
+                emit(0x76);
+            } else if (kind < 76) {
+                emit(r(2) ? 0xFB : 0xF3);
+            } else if (kind < 78) {
+                emit(0xE8 + r(2) * 0x10); emit(r.next());
+            } else if (kind < 80) {
+                emit(0x01 + 0x10 * r(3)); emit(r.next()); emit(r.next());
+            } else if (kind < 82) {
+                emit(0xF9);
+            } else if (kind < 84) {
+                emit(0x08); emit(r.next()); emit(0xC0 + r(0x20));
+            } else if (kind < 88) {
+                uint8_t op = 0x40 + r(0x40);
+                emit(op == 0x76 ? 0x00 : op);
+            } else {
+                emit(r.next());
+            }
+        }
+    }
+    header(rom, type, banks == 2 ? 0 : 2, type == 0x06 ? 0 : 3);
+    return rom;
+}
+
+// Code in bank 0 run from both windows, with MBC5 mapping bank 0 at 0x4000 too.
+// The routine switches the 0x4000 bank halfway, so run from there it has to carry
+// on in bank 1, where it adds to C instead of B. Ends halted with interrupts off.
+std::vector<uint8_t> aliased() {
+    std::vector<uint8_t> rom(4 * 0x4000);
+    size_t pc = 0x150;
+    auto emit = [&](std::initializer_list<uint8_t> bytes) {
+        for (uint8_t b : bytes) rom[pc++] = b;
+    };
+    emit({0x31, 0xF0, 0xDF});           // LD SP,0xDFF0
+    emit({0xF3, 0xAF, 0xE0, 0xFF});     // DI, XOR A, LDH (IE),A
+    emit({0x06, 0x00, 0x0E, 0x00});     // LD B,0; LD C,0
+    emit({0x16, 0x28});                 // LD D,40
+    size_t loop = pc;
+    emit({0xCD, 0x00, 0x02});           // CALL 0x0200
+    emit({0xAF, 0xEA, 0x00, 0x20});     // XOR A, LD (0x2000),A
+    emit({0xCD, 0x00, 0x42});           // CALL 0x4200
+    emit({0x15, 0x20});                 // DEC D, JR NZ,loop
+    emit({(uint8_t) (loop - (pc + 1))});
+    emit({0x76, 0x18, 0xFD});           // HALT, JR -3
+
+    pc = 0x200;
+    emit({0x3E, 0x01, 0xEA, 0x00, 0x20}); // LD A,1; LD (0x2000),A
+    emit({0x78, 0xC6, 0x11, 0x47, 0xC9}); // LD A,B; ADD A,0x11; LD B,A; RET
+    pc = 0x4205;
+    emit({0x79, 0xC6, 0x22, 0x4F, 0xC9}); // LD A,C; ADD A,0x22; LD C,A; RET
+
+    pc = 0;
+    header(rom, 0x19, 1, 0);
+    return rom;
+}
+
+uint64_t fnv(uint64_t h, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        h = (h ^ ((value >> (i * 8)) & 0xFF)) * 0x100000001B3;
+    }
+    return h;
+}
+
+// The registers after each of steps budgets, and the machine every CHECK of them.
+// Half the budgets are one cycle, a single instruction, the rest let the threaded
+// core chain handlers; every variant stops at the first instruction past a budget.
+void trace(const std::string& name, const std::vector<uint8_t>& rom, int seed, long steps) {
+    FILE* f = fopen(ROM, "wb");
+    if (!f || fwrite(rom.data(), 1, rom.size(), f) != rom.size()) {
+        fprintf(stderr, "%s: can't write\n", ROM);
+        exit(2);
+    }
+    fclose(f);
+    NicoGB nicogb;
+    nicogb.load(ROM, false);
+    remove(ROM);
+
+    // The boot ROM is the same for every ROM and takes a little longer than this
+    nicogb.runCycles(BOOT);
+
+    Random r{(uint64_t) seed};
+    uint64_t h = 0xCBF29CE484222325;
+    std::vector<uint8_t> state;
+    for (long step = 1; step <= steps; ++step) {
+        // Joypad interrupts too, a key at a time
+        if (step % 200000 == 100000) nicogb.keyDown(Key(step / 200000 % 8));
+        if (step % 200000 == 150000) nicogb.keyUp(Key(step / 200000 % 8));
+        nicogb.runCycles(r(2) ? 1 : 1 + r(256));
+        Registers regs = nicogb.registers();
+        h = fnv(h, regs.AF | (uint64_t) regs.BC << 16 | (uint64_t) regs.DE << 32 | (uint64_t) regs.HL << 48);
+        h = fnv(h, regs.SP | (uint64_t) regs.PC << 16 | nicogb.cycles() << 32);
+        if (step % CHECK == 0) {
+            nicogb.saveState(state);
+            uint64_t m = 0xCBF29CE484222325;
+            for (uint8_t byte : state) {
+                m = (m ^ byte) * 0x100000001B3;
+            }
+            printf("%s %ld %016llx %016llx\n", name.c_str(), step, (unsigned long long) h, (unsigned long long) m);
+        }
+    }
+}
+
+// A hand-made ROM run by the frame until well after it has halted, and the machine
+// then. Variants that can't be stopped at the same instructions, the JIT, are held
+// to these.
+void settle(const std::string& name, const std::vector<uint8_t>& rom) {
+    FILE* f = fopen(ROM, "wb");
+    if (!f || fwrite(rom.data(), 1, rom.size(), f) != rom.size()) {
+        fprintf(stderr, "%s: can't write\n", ROM);
+        exit(2);
+    }
+    fclose(f);
+    NicoGB nicogb;
+    nicogb.load(ROM, false);
+    nicogb.useJit(true); // No-op unless built with JIT=on
+    remove(ROM);
+
+    nicogb.runCycles(BOOT);
+    for (int frame = 0; frame < 60; ++frame) {
+        nicogb.runFrame();
+    }
+    Registers regs = nicogb.registers();
+    std::vector<uint8_t> state;
+    nicogb.saveState(state);
+    uint64_t m = 0xCBF29CE484222325;
+    for (uint8_t byte : state) {
+        m = (m ^ byte) * 0x100000001B3;
+    }
+    printf("%s AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x %016llx\n", name.c_str(),
+        regs.AF, regs.BC, regs.DE, regs.HL, regs.SP, regs.PC, (unsigned long long) m);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "cases") {
+        settle("aliased", aliased());
+        return 0;
+    }
+    for (int seed = 1; seed <= SEEDS; ++seed) {
+        trace("seed" + std::to_string(seed), generate(seed), seed, STEPS);
+    }
+    trace("aliased", aliased(), 1, CHECK);
+    return 0;
+}
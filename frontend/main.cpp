@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <thread>
+
+#include "SDL2/SDL.h"
+
+#include "nicogb.hpp"
+#include "rewind.hpp"
+#ifdef TEST
+#include "pool.hpp"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// One Game Boy frame of wall time at 4194304 Hz
+const auto PERIOD = std::chrono::nanoseconds(1000000000ull * NicoGB::FRAME / 4194304);
+
+Key getKey(SDL_Keycode sym) {
+    switch (sym) {
+        case SDLK_RIGHT:  return RIGHT;  break;
+        case SDLK_LEFT:   return LEFT;   break;
+        case SDLK_UP:     return UP;     break;
+        case SDLK_DOWN:   return DOWN;   break;
+        case SDLK_z:      return A;      break;
+        case SDLK_x:      return B;      break;
+        case SDLK_LSHIFT:
+        case SDLK_RSHIFT: return SELECT; break;
+        case SDLK_RETURN: return START;  break;
+        default:          return NONE;   break;
+    }
+}
+
+void run(NicoGB& nicogb) {
+    const int SCALE = 4;
+    const int WIDTH = 160;
+    const int HEIGHT = 144;
+
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Window *window = SDL_CreateWindow("NicoGB",
+        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+        WIDTH*SCALE, HEIGHT*SCALE, 0);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+    SDL_Texture *texture = SDL_CreateTexture(renderer,
+    SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, 160, 144);
+    SDL_UpdateTexture(texture, NULL, nicogb.framebuffer.data(), 160 * sizeof(uint32_t));
+
+    SDL_Event event;
+    SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
+    std::string path;
+    Key key;
+
+    // Every frame goes into the rewind buffer, held Backspace plays them back
+    Rewind rewind;
+    std::vector<uint8_t> state;
+    bool rewinding = false;
+
+    // Frames emulated ahead of the real one and shown instead, Tab cycles 0-3
+    unsigned runAhead = 0;
+    const std::vector<uint32_t>* screen = &nicogb.framebuffer;
+
+    auto frame = [&]() {
+        screen = &nicogb.runAhead(runAhead);
+        if (nicogb.loaded) {
+            nicogb.saveState(state);
+            rewind.push(state);
+        }
+    };
+
+    auto deadline = Clock::now();
+    bool run = true;
+    bool speed = false;
+    bool jit = false;
+    while (run) {
+        bool fast = speed && nicogb.loaded;
+        if (rewinding) {
+            if (rewind.pop(state)) {
+                nicogb.loadState(state);
+            }
+            screen = &nicogb.framebuffer;
+        } else if (fast) {
+            // Fast-forward: run uncapped, but still present about once per frame period
+            auto present = Clock::now() + PERIOD;
+            do {
+                frame();
+            } while (Clock::now() < present);
+            deadline = Clock::now();
+        } else {
+            frame();
+        }
+
+        SDL_UpdateTexture(texture, NULL, screen->data(), 160 * sizeof(uint32_t));
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+                case SDL_QUIT:
+                    run = false;
+                    break;
+
+                case SDL_DROPFILE:
+                    path = event.drop.file;
+                    nicogb.load(path);
+                    rewind.clear();
+                    SDL_SetWindowTitle(window, (std::string("NicoGB - ") + nicogb.title).c_str());
+                    break;
+
+                case SDL_KEYDOWN:
+                    switch (event.key.keysym.sym) {
+                        case SDLK_q:
+                            run = false;
+                            break;
+                        case SDLK_r:
+                            nicogb.init();
+                            rewind.clear();
+                            break;
+                        case SDLK_TAB:
+                            runAhead = (runAhead + 1) % 4;
+                            break;
+                        case SDLK_BACKSPACE:
+                            rewinding = true;
+                            break;
+                        case SDLK_SPACE:
+                            speed = !speed;
+                            break;
+                        case SDLK_j:
+                            jit = !jit;
+                            nicogb.useJit(jit);
+                            break;
+                        default:
+                            key = getKey(event.key.keysym.sym);
+                            nicogb.keyDown(key);
+                            break;
+                    }
+                    break;
+
+                case SDL_KEYUP:
+                    if (event.key.keysym.sym == SDLK_BACKSPACE) {
+                        rewinding = false;
+                    }
+                    key = getKey(event.key.keysym.sym);
+                    nicogb.keyUp(key);
+                    break;
+
+                default: break;
+            }
+        }
+
+        if (!fast) {
+            // Sleep off the rest of the frame; after a stall, start over instead of catching up
+            deadline += PERIOD;
+            if (deadline < Clock::now()) {
+                deadline = Clock::now();
+            } else {
+                std::this_thread::sleep_until(deadline);
+            }
+        }
+    }
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+#ifdef TEST
+
+// Budgets are in emulated time, so a slow or loaded CI machine gives the same results
+struct Suite {
+    std::string path;
+    uint64_t seconds;
+};
+
+enum Result {
+    PASS,
+    FAIL,
+    TIMEOUT,
+    MISSING,
+    ALLOCATES
+};
+
+// Heap allocations made by this thread. Once a ROM is running a frame must not
+// allocate, except to grow the serial output or, with BLOCKS=on, to compile blocks.
+thread_local uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* p = malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// blargg prints its verdict over the link port, mooneye ends with
+// LD B,B and Fibonacci numbers in B-L on success or 0x42 on failure
+Result check(NicoGB& nicogb) {
+    Registers r = nicogb.registers();
+    if (r.BC == 0x0305 && r.DE == 0x080D && r.HL == 0x1522) return PASS;
+    if (r.BC == 0x4242 && r.DE == 0x4242 && r.HL == 0x4242) return FAIL;
+    if (nicogb.serial.find("Passed") != std::string::npos) return PASS;
+    if (nicogb.serial.find("Failed") != std::string::npos) return FAIL;
+    return TIMEOUT;
+}
+
+Result assert(const std::string& rom, uint64_t seconds) {
+    NicoGB nicogb;
+    nicogb.load(rom, false);
+    nicogb.useJit(true); // No-op unless built with JIT=on
+    if (!nicogb.loaded) return MISSING;
+
+    uint64_t budget = seconds * 4194304;
+    while (nicogb.cycles() < budget) {
+        uint64_t before = allocations;
+        size_t serial = nicogb.serial.size();
+        nicogb.runFrame();
+        Result result = check(nicogb);
+        if (result != TIMEOUT) return result;
+#ifndef BLOCK_CACHE
+        if (allocations != before && nicogb.serial.size() == serial) return ALLOCATES;
+#endif
+    }
+    return TIMEOUT;
+}
+
+#endif
+
+int main() {
+
+#ifndef TEST
+
+    NicoGB nicogb;
+    run(nicogb);
+
+#else
+
+    const std::vector<Suite> suites {
+        {"tests/blargg/", 120},
+        {"tests/mooneye/", 20},
+    };
+    const char* RESULTS[] = {"pass", "fail", "timeout", "file not found", "allocates during a frame"};
+
+    std::vector<std::pair<std::string, uint64_t>> roms;
+    for (auto& suite: suites) {
+        if (suite.path.find(".gb") != std::string::npos || !std::filesystem::exists(suite.path)) {
+            roms.emplace_back(suite.path, suite.seconds);
+            continue;
+        }
+        for(auto& p: std::filesystem::recursive_directory_iterator(suite.path)) {
+            if(p.path().extension() == ".gb") {
+                roms.emplace_back(p.path(), suite.seconds);
+            }
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+
+    // One NicoGB per ROM, one ROM per worker at a time
+    std::vector<Result> results(roms.size());
+    {
+        Pool pool(std::thread::hardware_concurrency());
+        for (size_t i = 0; i < roms.size(); ++i) {
+            pool.submit([&, i] { results[i] = assert(roms[i].first, roms[i].second); });
+        }
+        pool.wait();
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < roms.size(); ++i) {
+        printf("%s: %s\n", roms[i].first.c_str(), RESULTS[results[i]]);
+        failed += results[i] != PASS;
+    }
+    printf("%zu passed, %d failed\n", roms.size() - failed, failed);
+    return failed ? 1 : 0;
+
+#endif
+
+    return 0;
+}
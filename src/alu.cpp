@@ -0,0 +1,57 @@
+#include "alu.hpp"
+
+const ALU alu;
+
+ALU::ALU() {
+    for (int c = 0; c < 2; ++c) {
+        for (int a = 0; a < 256; ++a) {
+            for (int n = 0; n < 256; ++n) {
+                int r = a + n + c;
+                add[c][a][n] = ((r & 0xFF) == 0 ? 0x80 : 0)
+                    | (((a & 0x0F) + (n & 0x0F) + c) > 0x0F ? 0x20 : 0)
+                    | (r > 0xFF ? 0x10 : 0);
+                r = a - n - c;
+                sub[c][a][n] = ((r & 0xFF) == 0 ? 0x80 : 0) | 0x40
+                    | (((a & 0x0F) - (n & 0x0F) - c) < 0 ? 0x20 : 0)
+                    | (r < 0 ? 0x10 : 0);
+            }
+        }
+    }
+
+    for (int n = 0; n < 256; ++n) {
+        inc[n] = (n == 0 ? 0x80 : 0) | ((n & 0x0F) == 0 ? 0x20 : 0);
+        dec[n] = (n == 1 ? 0x80 : 0) | 0x40 | ((n & 0x0F) == 0 ? 0x20 : 0);
+    }
+
+    for (int c = 0; c < 2; ++c) {
+        for (int n = 0; n < 256; ++n) {
+            uint8_t r[8], carry[8];
+            r[RLC] = (n << 1) | (n >> 7);         carry[RLC] = n >> 7;
+            r[RRC] = (n >> 1) | (n << 7);         carry[RRC] = n & 0x1;
+            r[RL] = (n << 1) | c;                 carry[RL] = n >> 7;
+            r[RR] = (n >> 1) | (c << 7);          carry[RR] = n & 0x1;
+            r[SLA] = n << 1;                      carry[SLA] = n >> 7;
+            r[SRA] = (n >> 1) | (n & 0x80);       carry[SRA] = n & 0x1;
+            r[SWAP] = (n << 4) | (n >> 4);        carry[SWAP] = 0;
+            r[SRL] = n >> 1;                      carry[SRL] = n & 0x1;
+            for (int op = 0; op < 8; ++op) {
+                shift[op][c][n] = (r[op] << 8) | (r[op] == 0 ? 0x80 : 0) | (carry[op] << 4);
+            }
+        }
+    }
+
+    for (int flags = 0; flags < 8; ++flags) {
+        bool N = flags & 0x4, H = flags & 0x2, C = flags & 0x1;
+        for (int a = 0; a < 256; ++a) {
+            uint8_t n = 0;
+            if (H || (!N && ((a & 0xF) > 0x09))) {
+                n |= 0x06;
+            }
+            if (C || (!N && (a > 0x99))) {
+                n |= 0x60;
+            }
+            uint8_t r = a + (N ? -n : n);
+            daa[flags][a] = (r << 8) | (r == 0 ? 0x80 : 0) | (N ? 0x40 : 0) | (n > 0x06 ? 0x10 : 0);
+        }
+    }
+}
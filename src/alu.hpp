@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Flag tables for the 8-bit ALU, built once at startup
+class ALU {
+    public:
+        enum Shift {
+            RLC,
+            RRC,
+            RL,
+            RR,
+            SLA,
+            SRA,
+            SWAP,
+            SRL
+        };
+
+        uint8_t add[2][256][256];  // [carry][a][n] -> F of ADD/ADC
+        uint8_t sub[2][256][256];  // [carry][a][n] -> F of SUB/SBC/CP
+        uint8_t inc[256];          // [result] -> Z and H of INC
+        uint8_t dec[256];          // [operand] -> Z, N and H of DEC
+        uint16_t shift[8][2][256]; // [op][carry][n] -> result << 8 | F
+        uint16_t daa[8][256];      // [NHC][a] -> A << 8 | F
+        ALU();
+};
+
+extern const ALU alu;
@@ -0,0 +1,180 @@
+#include <algorithm>
+
+#include "blockcache.hpp"
+#include "memory.hpp"
+
+// Instruction lengths in bytes, CB counts its second byte
+const uint8_t LENGTH[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+};
+
+// M-cycles with no branch taken, CB ops are added on top of the prefix
+const uint8_t CYCLES[256] = {
+    1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1,
+    1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1,
+    2, 3, 2, 2, 1, 1, 2, 1, 2, 2, 2, 2, 1, 1, 2, 1,
+    2, 3, 2, 2, 3, 3, 3, 1, 2, 2, 2, 2, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    2, 2, 2, 2, 2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 3, 4, 3, 4, 2, 4, 2, 4, 3, 1, 3, 6, 2, 4,
+    2, 3, 3, 1, 3, 4, 2, 4, 2, 4, 3, 1, 3, 1, 2, 4,
+    3, 3, 2, 1, 1, 4, 2, 4, 4, 1, 4, 1, 1, 1, 2, 4,
+    3, 3, 2, 1, 1, 4, 2, 4, 3, 2, 4, 1, 1, 1, 2, 4,
+};
+
+// Jumps, calls, returns, RST, HALT, STOP and the unused opcodes end a block
+static bool ends(uint8_t opcode) {
+    switch (opcode) {
+        case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: case 0x76:
+        case 0xC0: case 0xC2: case 0xC3: case 0xC4: case 0xC7: case 0xC8: case 0xC9:
+        case 0xCA: case 0xCC: case 0xCD: case 0xCF: case 0xD0: case 0xD2: case 0xD3:
+        case 0xD4: case 0xD7: case 0xD8: case 0xD9: case 0xDA: case 0xDB: case 0xDC:
+        case 0xDD: case 0xDF: case 0xE3: case 0xE4: case 0xE7: case 0xE9: case 0xEB:
+        case 0xEC: case 0xED: case 0xEF: case 0xF4: case 0xF7: case 0xFC: case 0xFD:
+        case 0xFF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+double BlockCache::Stats::hitRate() const {
+    return lookups ? (double) hits / lookups : 0;
+}
+
+BlockCache::BlockCache(Memory& memory) : memory(memory) {
+    clear();
+}
+
+void BlockCache::clear() {
+    blocks[0].clear();
+    blocks[1].clear();
+    clears++;
+    std::fill_n(recent, 0x400, nullptr);
+    stats = Stats();
+    reset();
+}
+
+void BlockCache::reset() {
+    block = nullptr;
+    index = 0;
+    nextPC = 0;
+}
+
+// Called by Memory when the bank under a ROM window changes
+void BlockCache::invalidate(int window) {
+    switches[window]++;
+    if (block && (block->pc >> 14) == window) {
+        stats.invalidations++;
+        reset();
+    }
+}
+
+// Returns the op at PC, or nullptr if it has to be fetched from memory
+const BlockCache::Op* BlockCache::next(uint16_t pc) {
+    if (!block || pc != nextPC || index == block->ops.size()) {
+        block = lookup(pc);
+        index = 0;
+        if (!block || block->ops.empty()) {
+            block = nullptr;
+            stats.uncached++;
+            return nullptr;
+        }
+    }
+    const Op* op = &block->ops[index++];
+    nextPC = pc + op->length;
+    stats.cycles += op->cycles;
+    return op;
+}
+
+// Returns the block starting at PC, or nullptr while PC is inside the running block
+BlockCache::Block* BlockCache::enter(uint16_t pc) {
+    if (block && pc == nextPC && index < block->ops.size()) {
+        return nullptr;
+    }
+    block = lookup(pc);
+    index = 0;
+    nextPC = pc;
+    if (block && block->ops.empty()) {
+        block = nullptr;
+    }
+    return block;
+}
+
+BlockCache::Block* BlockCache::lookup(uint16_t pc) {
+    uint8_t* page = memory.readMap[pc >> 8];
+    if (pc >= 0x8000 || !page || (pc < 0x100 && memory.bootEnabled)) {
+        return nullptr;
+    }
+
+    const uint8_t* key = page + (pc & 0xFF);
+    stats.lookups++;
+    Block*& slot = recent[(pc ^ ((uintptr_t) key >> 14)) & 0x3FF];
+    if (slot && slot->key == key && slot->pc == pc) {
+        stats.hits++;
+        return slot;
+    }
+
+    auto& window = blocks[pc >> 14];
+    auto found = window.find(key);
+    if (found != window.end()) {
+        stats.hits++;
+    } else {
+        found = window.emplace(key, Block{key, pc, {}, 0, nullptr}).first;
+        compile(found->second);
+        stats.compiled++;
+    }
+    slot = &found->second;
+    return slot;
+}
+
+// Decodes up to the next branch, stopping short of the ROM window boundary
+void BlockCache::compile(Block& block) {
+    const uint8_t* code = block.key;
+    uint16_t pc = block.pc;
+    uint16_t end = (pc & 0xC000) + 0x4000;
+    while (block.ops.size() < 64) {
+        Op op = {};
+        op.opcode = code[0];
+        op.length = LENGTH[op.opcode];
+        if (pc + op.length > end) {
+            break;
+        }
+        op.cycles = CYCLES[op.opcode];
+        for (int i = 1; i < op.length; ++i) {
+            op.operand[i - 1] = code[i];
+        }
+        if (op.opcode == 0xCB) {
+            bool hl = (op.operand[0] & 0x07) == 0x06;
+            bool bit = (op.operand[0] & 0xC0) == 0x40;
+            op.cycles += hl ? (bit ? 2 : 3) : 1;
+        }
+        block.ops.push_back(op);
+        if (ends(op.opcode)) {
+            break;
+        }
+        code += op.length;
+        pc += op.length;
+    }
+}
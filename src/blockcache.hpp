@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+class Memory;
+
+// Pre-decoded straight-line runs of ROM code. A block is keyed by the host
+// address of its first byte, which identifies the ROM bank, and by the window it
+// runs in, as a bank can be mapped in both (MBC5 bank 0, or banks wrapping).
+class BlockCache {
+    public:
+        struct Op {
+            uint8_t opcode;
+            uint8_t operand[2];
+            uint8_t length;
+            uint8_t cycles; // M-cycles with no branch taken
+        };
+
+        struct Block {
+            const uint8_t* key;
+            uint16_t pc;
+            std::vector<Op> ops;
+            uint32_t runs; // Entries, so the JIT can spot hot blocks
+            void* code;    // Native code, nullptr until the JIT compiles it
+        };
+
+        struct Stats {
+            uint64_t lookups;       // Blocks entered from a cacheable PC
+            uint64_t hits;          // ... that were already compiled
+            uint64_t compiled;
+            uint64_t uncached;      // Instructions run outside ROM or from the boot ROM
+            uint64_t invalidations; // Bank switches under the running block
+            uint64_t cycles;        // M-cycles of the ops run from the cache
+            double hitRate() const;
+        };
+
+        Stats stats;
+        uint32_t switches[2] = {}; // Bank switches of each ROM window
+        uint32_t clears = 0;
+        const Op* next(uint16_t pc);
+        Block* enter(uint16_t pc);
+        void invalidate(int window);
+        void reset();
+        void clear();
+        BlockCache(Memory& memory);
+
+    private:
+        Memory& memory;
+        std::unordered_map<const uint8_t*, Block> blocks[2]; // Per ROM window
+        Block* recent[0x400] = {};
+        Block* block;
+        uint32_t index;
+        uint16_t nextPC;
+        Block* lookup(uint16_t pc);
+        void compile(Block& block);
+};
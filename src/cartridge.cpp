@@ -1,40 +1,39 @@
-#include <fstream>
+#include <type_traits>
 
 #include "cartridge.hpp"
+#include "state.hpp"
 
-Cartridge::Cartridge() {
-    cartridgeROM = std::vector<uint8_t>();
-    cartridgeRAM = std::vector<uint8_t>();
+Cartridge::Cartridge(Scheduler& scheduler) : scheduler(scheduler) {
+    cartridgeROM = std::make_shared<ROM>();
     title = "";
     loaded = false;
+    speculative = false;
     cartridgeType = 0;
     romSize = 0;
     ramSize = 0;
 }
 
-void Cartridge::load(std::string path) {
-    std::ifstream cartridgeFile(path, std::ifstream::binary);
+Cartridge::~Cartridge() {
+    saveClock();
+}
+
+void Cartridge::load(std::string path, bool battery) {
+    // Mapped, or shared with other instances of the same file
+    std::shared_ptr<ROM> rom = ROM::open(path);
 
-    if (!cartridgeFile.is_open()) {
+    if (!rom || rom->size == 0 || rom->size % 32768 != 0) {
         loaded = false;
         return;
     } else {
-        cartridgeFile.seekg(0, cartridgeFile.end);
-        romSize = cartridgeFile.tellg();
-        cartridgeFile.seekg(0, cartridgeFile.beg);
-        cartridgeFile.clear();
-        if (romSize % 32768 != 0) {
-            loaded = false;
-            cartridgeFile.close();
-            return;
-        }
-        cartridgeROM.resize(romSize);
-        cartridgeFile.read((char*) cartridgeROM.data(), romSize);
-        cartridgeFile.close();
+        saveClock();
+        save.reset();
+        clock = nullptr;
+        cartridgeROM = rom;
+        romSize = rom->size;
         loaded = true;
 
-        cartridgeType = cartridgeROM[0x0147];
-        switch (cartridgeROM[0x0149]) {
+        cartridgeType = cartridgeROM->data[0x0147];
+        switch (cartridgeROM->data[0x0149]) {
             case 0:  ramSize = 1;         break;
             case 1:  ramSize = 2048;      break;
             case 2:  ramSize = 8192;      break;
@@ -48,77 +47,200 @@ void Cartridge::load(std::string path) {
             ramSize = 512;
         }
 
-        cartridgeRAM.resize(ramSize);
-        std::fill_n(cartridgeRAM.begin(), ramSize, 0);
-
-        int titleSize = cartridgeROM[0x0143] & 0x80 ? 15 : 16; // CGB Flag
-        title.assign(&cartridgeROM[0x0134], &cartridgeROM[0x0134] + titleSize);
-
+        // Battery backed RAM lives in a .sav next to the ROM, followed by the clock
+        cartridgeRAM.allocate(ramSize);
+        bool ram = ramSize >= (int) Pages::SIZE;
+        bool timer = cartridgeType == 0x0F || cartridgeType == 0x10;
         switch (cartridgeType) {
-            // ROM
-            case 0x00:
-            case 0x08:
-            case 0x09:
-                mbc.reset(new MBC0(cartridgeROM, cartridgeRAM, ramSize));
+            case 0x03: // MBC1+RAM+BATTERY
+            case 0x06: // MBC2+BATTERY
+            case 0x0F: // MBC3+TIMER+BATTERY
+            case 0x10: // MBC3+TIMER+RAM+BATTERY
+            case 0x13: // MBC3+RAM+BATTERY
+            case 0x1B: // MBC5+RAM+BATTERY
+            case 0x1E: // MBC5+RUMBLE+RAM+BATTERY
+                if (battery && (ram || timer)) {
+                    size_t extension = path.find_last_of('.');
+                    if (extension == std::string::npos || extension < path.find_last_of("/\\") + 1) {
+                        extension = path.size();
+                    }
+                    save = Save::open(path.substr(0, extension) + ".sav", (ram ? ramSize : 0) + (timer ? MBC3::CLOCK : 0));
+                    if (ram) {
+                        cartridgeRAM.map(save->data, ramSize, save);
+                    }
+                    if (timer) {
+                        clock = save->data + (ram ? ramSize : 0);
+                    }
+                }
                 break;
+        }
 
-            // MBC1
-            case 0x01:
-            case 0x02:
-            case 0x03:
-                mbc.reset(new MBC1(cartridgeROM, cartridgeRAM, romSize, ramSize));
-                break;
+        int titleSize = cartridgeROM->data[0x0143] & 0x80 ? 15 : 16; // CGB Flag
+        title.assign(cartridgeROM->data + 0x0134, cartridgeROM->data + 0x0134 + titleSize);
+        attach();
+        if (clock) {
+            std::get<MBC3>(mbc).loadClock(clock);
+        }
+    }
+}
 
-            // MBC2
-            case 0x05:
-            case 0x06:
-                mbc.reset(new MBC2(cartridgeROM, cartridgeRAM, romSize, ramSize));
-                break;
+// Sets up the MBC for the cartridge type over the ROM and RAM buffers
+void Cartridge::attach() {
+    switch (cartridgeType) {
+        // ROM
+        case 0x00:
+        case 0x08:
+        case 0x09:
+            banks = &mbc.emplace<MBC0>(*cartridgeROM, cartridgeRAM, ramSize);
+            break;
+
+        // MBC1
+        case 0x01:
+        case 0x02:
+        case 0x03:
+            banks = &mbc.emplace<MBC1>(*cartridgeROM, cartridgeRAM, romSize, ramSize);
+            break;
+
+        // MBC2
+        case 0x05:
+        case 0x06:
+            banks = &mbc.emplace<MBC2>(*cartridgeROM, cartridgeRAM, romSize, ramSize);
+            break;
+
+        // MMM01
+        // case 0x0B:
+        // case 0x0C:
+        // case 0x0D:
+            // break;
+
+        // MBC3
+        case 0x0F:
+        case 0x10:
+        case 0x11:
+        case 0x12:
+        case 0x13:
+            banks = &mbc.emplace<MBC3>(*cartridgeROM, cartridgeRAM, romSize, ramSize, scheduler);
+            break;
+
+        // MBC5
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+        case 0x1C:
+        case 0x1D:
+        case 0x1E:
+            banks = &mbc.emplace<MBC5>(*cartridgeROM, cartridgeRAM, romSize, ramSize);
+            break;
+
+        // MBC6
+        // case 0x20:
+        //     break;
+
+        // MBC7
+        // case 0x22:
+        //     break;
+
+        default:
+            banks = &mbc.emplace<MBC0>(*cartridgeROM, cartridgeRAM, ramSize);
+            break;
+    }
+}
 
-            // MMM01
-            // case 0x0B:
-            // case 0x0C:
-            // case 0x0D:
-                // break;
-
-            // MBC3
-            case 0x0F:
-            case 0x10:
-            case 0x11:
-            case 0x12:
-            case 0x13:
-                mbc.reset(new MBC3(cartridgeROM, cartridgeRAM, romSize, ramSize));
-                break;
+uint8_t Cartridge::read(uint16_t address) {
+    return std::visit([address](auto& m) -> uint8_t {
+        if constexpr (std::is_same_v<std::decay_t<decltype(m)>, std::monostate>) {
+            return 0xFF;
+        } else {
+            return m.read(address);
+        }
+    }, mbc);
+}
 
-            // MBC5
-            case 0x19:
-            case 0x1A:
-            case 0x1B:
-            case 0x1C:
-            case 0x1D:
-            case 0x1E:
-                mbc.reset(new MBC5(cartridgeROM, cartridgeRAM, romSize, ramSize));
-                break;
+void Cartridge::write(uint16_t address, uint8_t n) {
+    bool enabled = banks && banks->ramg;
+    std::visit([address, n](auto& m) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(m)>, std::monostate>) {
+            m.write(address, n);
+        }
+    }, mbc);
+    // Games disable RAM once they are done saving
+    if (save && enabled && !banks->ramg) {
+        sync(false);
+    }
+}
 
-            // MBC6
-            // case 0x20:
-            //     break;
+void Cartridge::sync(bool wait) {
+    if (save && !speculative) {
+        saveClock();
+        save->sync(wait);
+    }
+}
 
-            // MBC7
-            // case 0x22:
-            //     break;
+void Cartridge::saveClock() {
+    if (clock) {
+        std::get<MBC3>(mbc).saveClock(clock);
+    }
+}
 
-            default:
-                mbc.reset(new MBC0(cartridgeROM, cartridgeRAM, ramSize));
-                break;
-        }
+uint8_t* Cartridge::readPage(uint16_t address) {
+    if (!banks) {
+        return nullptr;
+    } else if (address <= 0x3FFF) {
+        return banks->rom0 + (address & 0x3F00);
+    } else if (address <= 0x7FFF) {
+        return banks->romx + (address & 0x3F00);
+    } else if (address >= 0xA000 && address <= 0xBFFF && banks->sramRead >= 0) {
+        return cartridgeRAM.read((banks->sramRead + (address & banks->ramMask)) / Pages::SIZE);
+    } else {
+        return nullptr;
     }
 }
 
-uint8_t Cartridge::read(uint16_t address) {
-    return mbc->read(address);
+// RAM pages shared with a fork get no write map entry until the MBC copies them
+uint8_t* Cartridge::writePage(uint16_t address) {
+    if (banks && address >= 0xA000 && address <= 0xBFFF && banks->sramWrite >= 0) {
+        size_t page = (banks->sramWrite + (address & banks->ramMask)) / Pages::SIZE;
+        return cartridgeRAM.isOwned(page) ? cartridgeRAM.read(page) : nullptr;
+    } else {
+        return nullptr;
+    }
 }
 
-void Cartridge::write(uint16_t address, uint8_t n) {
-    mbc->write(address, n);
+// States only load into the cartridge they were saved from
+void Cartridge::serialize(State& state) {
+    state.check(romSize);
+    state.check(loaded ? cartridgeROM->data[0x014E] << 8 | cartridgeROM->data[0x014F] : 0);
+    state.check(cartridgeType);
+    cartridgeRAM.serialize(state);
+    if (!state.ok) {
+        return;
+    }
+    serializeBanks(state);
+}
+
+void Cartridge::serializeBanks(State& state) {
+    std::visit([&state](auto& m) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(m)>, std::monostate>) {
+            m.serialize(state);
+        }
+    }, mbc);
+}
+
+// Same ROM buffer and RAM pages, copied on the first write from either side
+void Cartridge::share(Cartridge& from) {
+    title = from.title;
+    loaded = from.loaded;
+    cartridgeType = from.cartridgeType;
+    romSize = from.romSize;
+    ramSize = from.ramSize;
+    cartridgeROM = from.cartridgeROM;
+    cartridgeRAM.share(from.cartridgeRAM);
+    if (!loaded) {
+        return;
+    }
+    attach();
+    State banks;
+    from.serializeBanks(banks);
+    banks.start(true);
+    serializeBanks(banks);
 }
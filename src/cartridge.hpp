@@ -1,26 +1,45 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
-#include <memory>
+#include <variant>
 
 #include "mbc.hpp"
+#include "save.hpp"
+
+class State;
+class Scheduler;
 
 class Cartridge {
     public:
         std::string title;
         bool loaded;
-        void load(std::string path);
+        bool speculative; // Frames that will be rolled back, nothing reaches the .sav
+        void load(std::string path, bool battery);
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
-        Cartridge();
+        uint8_t* readPage(uint16_t address);
+        uint8_t* writePage(uint16_t address);
+        void serialize(State& state);
+        void share(Cartridge& from);
+        void sync(bool wait);
+        Cartridge(Scheduler& scheduler);
+        ~Cartridge();
 
     private:
-        std::unique_ptr<MBC> mbc;
-        std::vector<uint8_t> cartridgeROM;
-        std::vector<uint8_t> cartridgeRAM;
+        Scheduler& scheduler;
+        std::variant<std::monostate, MBC0, MBC1, MBC2, MBC3, MBC5> mbc;
+        MBC* banks = nullptr;
+        std::shared_ptr<ROM> cartridgeROM;
+        Pages cartridgeRAM;
+        std::shared_ptr<Save> save; // Battery backed RAM, nullptr when not kept
+        uint8_t* clock = nullptr;   // MBC3 clock in save, after the RAM
         uint8_t cartridgeType;
         size_t romSize;
         int ramSize;
+        void attach();
+        void serializeBanks(State& state);
+        void saveClock();
 };
@@ -0,0 +1,145 @@
+#include "compositor.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define COMPOSITOR_X86
+#endif
+
+Compositor::Level Compositor::level = Compositor::detect();
+
+Compositor::Level Compositor::detect() {
+#ifdef COMPOSITOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return AVX2;
+    if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+    return SCALAR;
+}
+
+static void shadeScalar(uint32_t* out, const uint8_t* colors, const uint32_t* palette, int n) {
+    for (int i = 0; i < n; ++i) {
+        out[i] = palette[colors[i]];
+    }
+}
+
+static void spriteScalar(uint32_t* out, const uint8_t* colors, const uint8_t* background,
+    const uint32_t* palette, bool priority, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (colors[i] != 0 && !(priority && background[i] != 0)) {
+            out[i] = palette[colors[i]];
+        }
+    }
+}
+
+#ifdef COMPOSITOR_X86
+
+// vpermd looks up 8 pixels at once, the indices only reach the low 4 entries
+__attribute__((target("avx2")))
+static void shadeAVX2(uint32_t* out, const uint8_t* colors, const uint32_t* palette, int n) {
+    __m256i table = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) palette));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (colors + i)));
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_permutevar8x32_epi32(table, index));
+    }
+    shadeScalar(out + i, colors + i, palette, n - i);
+}
+
+// A sprite row is 8 pixels, clipped ones at the screen edges take the scalar path
+__attribute__((target("avx2")))
+static void spriteAVX2(uint32_t* out, const uint8_t* colors, const uint8_t* background,
+    const uint32_t* palette, bool priority, int n) {
+    if (n != 8) {
+        spriteScalar(out, colors, background, palette, priority, n);
+        return;
+    }
+    __m256i table = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) palette));
+    __m256i zero = _mm256_setzero_si256();
+    __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) colors));
+    __m256i skip = _mm256_cmpeq_epi32(index, zero);
+    if (priority) {
+        __m256i behind = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) background));
+        skip = _mm256_or_si256(skip, _mm256_xor_si256(_mm256_cmpeq_epi32(behind, zero), _mm256_set1_epi32(-1)));
+    }
+    __m256i pixels = _mm256_permutevar8x32_epi32(table, index);
+    __m256i old = _mm256_loadu_si256((const __m256i*) out);
+    _mm256_storeu_si256((__m256i*) out, _mm256_blendv_epi8(pixels, old, skip));
+}
+
+// Without a variable shuffle the two index bits pick between the four colors
+__attribute__((target("sse2")))
+static inline __m128i lookupSSE2(__m128i index, const __m128i* colors) {
+    __m128i low = _mm_cmpeq_epi32(_mm_and_si128(index, _mm_set1_epi32(1)), _mm_set1_epi32(1));
+    __m128i high = _mm_cmpeq_epi32(_mm_and_si128(index, _mm_set1_epi32(2)), _mm_set1_epi32(2));
+    __m128i light = _mm_or_si128(_mm_and_si128(low, colors[1]), _mm_andnot_si128(low, colors[0]));
+    __m128i dark = _mm_or_si128(_mm_and_si128(low, colors[3]), _mm_andnot_si128(low, colors[2]));
+    return _mm_or_si128(_mm_and_si128(high, dark), _mm_andnot_si128(high, light));
+}
+
+__attribute__((target("sse2")))
+static void shadeSSE2(uint32_t* out, const uint8_t* colors, const uint32_t* palette, int n) {
+    const __m128i table[4] = {
+        _mm_set1_epi32(palette[0]), _mm_set1_epi32(palette[1]), _mm_set1_epi32(palette[2]), _mm_set1_epi32(palette[3])
+    };
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (colors + i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128((__m128i*) (out + i), lookupSSE2(_mm_unpacklo_epi16(low, zero), table));
+        _mm_storeu_si128((__m128i*) (out + i + 4), lookupSSE2(_mm_unpackhi_epi16(low, zero), table));
+        _mm_storeu_si128((__m128i*) (out + i + 8), lookupSSE2(_mm_unpacklo_epi16(high, zero), table));
+        _mm_storeu_si128((__m128i*) (out + i + 12), lookupSSE2(_mm_unpackhi_epi16(high, zero), table));
+    }
+    shadeScalar(out + i, colors + i, palette, n - i);
+}
+
+__attribute__((target("sse2")))
+static void spriteSSE2(uint32_t* out, const uint8_t* colors, const uint8_t* background,
+    const uint32_t* palette, bool priority, int n) {
+    if (n != 8) {
+        spriteScalar(out, colors, background, palette, priority, n);
+        return;
+    }
+    const __m128i table[4] = {
+        _mm_set1_epi32(palette[0]), _mm_set1_epi32(palette[1]), _mm_set1_epi32(palette[2]), _mm_set1_epi32(palette[3])
+    };
+    __m128i zero = _mm_setzero_si128();
+    __m128i index = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) colors), zero);
+    __m128i behind = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) background), zero);
+    for (int half = 0; half < 2; ++half) {
+        __m128i color = half ? _mm_unpackhi_epi16(index, zero) : _mm_unpacklo_epi16(index, zero);
+        __m128i skip = _mm_cmpeq_epi32(color, zero);
+        if (priority) {
+            __m128i bg = half ? _mm_unpackhi_epi16(behind, zero) : _mm_unpacklo_epi16(behind, zero);
+            skip = _mm_or_si128(skip, _mm_xor_si128(_mm_cmpeq_epi32(bg, zero), _mm_set1_epi32(-1)));
+        }
+        __m128i old = _mm_loadu_si128((const __m128i*) (out + half * 4));
+        __m128i pixels = lookupSSE2(color, table);
+        _mm_storeu_si128((__m128i*) (out + half * 4), _mm_or_si128(_mm_and_si128(skip, old), _mm_andnot_si128(skip, pixels)));
+    }
+}
+
+#endif
+
+void Compositor::shade(uint32_t* out, const uint8_t* colors, const uint32_t* palette, int n) {
+    switch (level) {
+#ifdef COMPOSITOR_X86
+        case AVX2: shadeAVX2(out, colors, palette, n); break;
+        case SSE2: shadeSSE2(out, colors, palette, n); break;
+#endif
+        default:   shadeScalar(out, colors, palette, n); break;
+    }
+}
+
+void Compositor::sprite(uint32_t* out, const uint8_t* colors, const uint8_t* background,
+    const uint32_t* palette, bool priority, int n) {
+    switch (level) {
+#ifdef COMPOSITOR_X86
+        case AVX2: spriteAVX2(out, colors, background, palette, priority, n); break;
+        case SSE2: spriteSSE2(out, colors, background, palette, priority, n); break;
+#endif
+        default:   spriteScalar(out, colors, background, palette, priority, n); break;
+    }
+}
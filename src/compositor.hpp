@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Turns color indices into ARGB pixels, for a whole line of background and window
+// or one row of a sprite. AVX2 or SSE2 where CPUID reports them, plain C++ otherwise.
+class Compositor {
+    public:
+        enum Level {
+            SCALAR,
+            SSE2,
+            AVX2
+        };
+
+        // Detected once at startup, lowering it selects a slower path
+        static Level level;
+        static Level detect();
+
+        // out[i] = palette[colors[i]]
+        static void shade(uint32_t* out, const uint8_t* colors, const uint32_t* palette, int n);
+        // The same for nonzero colors, and with priority only where the background is color 0
+        static void sprite(uint32_t* out, const uint8_t* colors, const uint8_t* background,
+            const uint32_t* palette, bool priority, int n);
+};
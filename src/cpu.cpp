@@ -1,8 +1,15 @@
+#include <algorithm>
+
 #include "cpu.hpp"
 #include "timer.hpp"
 #include "joypad.hpp"
 #include "memory.hpp"
 #include "ppu.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+#ifdef ALU_TABLES
+#include "alu.hpp"
+#endif
 
 const uint8_t ZERO = 0x80;
 const uint8_t NEG = 0x40;
@@ -18,12 +25,33 @@ const uint8_t JOYPAD = 0x10;
 const uint16_t IE = 0xFFFF;
 const uint16_t IF = 0xFF0F;
 
+// The threaded core jumps straight to the label of each handler, and each handler
+// fetches the next opcode and jumps to its handler in turn. Compilers without
+// computed goto fall back to the switch, one instruction per call.
+#if defined(THREADED_CORE) && defined(__GNUC__)
+#define THREADED
+#define OP(n) case n: op_##n
+#define CB(n) case n: cb_##n
+#define OP_DEFAULT default: op_default
+#define NEXT goto next
+#else
+#define OP(n) case n
+#define CB(n) case n
+#define OP_DEFAULT default
+#define NEXT break
+#endif
+
 CPU::CPU(Memory& memory, PPU& ppu) :
-    memory(memory), ppu(ppu),
+    memory(memory), ppu(ppu), scheduler(memory.scheduler),
+#ifdef JIT
+    jit(*this),
+#endif
     AF(af.value), A(af.high), F(af.low),
     BC(bc.value), B(bc.high), C(bc.low),
     DE(de.value), D(de.high), E(de.low),
     HL(hl.value), H(hl.high), L(hl.low) {
+    limit = 0;
+    dispatched = false;
     init();
 }
 
@@ -35,48 +63,132 @@ void CPU::init() {
     SP = 0;
     PC = 0;
     opcode = 0;
+    operand = nullptr;
 
     totalCycles = 0;
     halted = 0;
     haltBug = 0;
     IRQ = 0;
     IME = 0;
+    interrupt = 0;
     run = true;
+#ifdef LAZY_FLAGS
+    flags = EAGER;
+#endif
 }
 
 void CPU::tick() {
-    memory.timer.counter += 4;
     totalCycles += 4;
+    scheduler.cycles += 4;
 
-    if (memory.timer.reload > 0) {
-        memory.timer.reload -= 4;
-        if (memory.timer.reload == 0) {
-            memory.interrupt(TIMER);
-            memory.timer.tima = memory.timer.tma;
-        }
+    if (scheduler.cycles >= scheduler.next) {
+        dispatch();
+    }
+}
+
+void CPU::dispatch() {
+    dispatched = true;
+    if (scheduler.due(Scheduler::TIMER) && memory.timer.update()) {
+        memory.interrupt(TIMER);
     }
 
-    if (memory.timer.fallingEdge()) {
-        memory.timer.tima++;
-        if (memory.timer.tima == 0) {
-            memory.timer.reload = 4;
+    if (scheduler.due(Scheduler::DMA)) {
+        if (!halted) {
+            memory.transfer();
+        } else {
+            scheduler.schedule(Scheduler::DMA, scheduler.cycles + 4);
         }
     }
-    memory.timer.oldEdge = memory.timer.currentEdge();
 
-    if (!halted) {
-        memory.transfer();
+    if (scheduler.due(Scheduler::LCD)) {
+        ppu.update();
     }
 
-    ppu.update();
+    if (scheduler.due(Scheduler::SERIAL)) {
+        memory.serial();
+    }
 }
 
 // Current flag
+#ifdef LAZY_FLAGS
+uint8_t CPU::ZERO_F() {
+    if (flags == EAGER) return AF & ZERO;
+    return (flagR & 0xFF) == 0 ? ZERO : 0;
+}
+
+uint8_t CPU::SUB_F() {
+    if (flags == EAGER) return AF & NEG;
+    return (flags == SUBTRACTED || flags == DECREMENTED) ? NEG : 0;
+}
+
+uint8_t CPU::HALF_F() {
+    if (flags == EAGER) return AF & HALF;
+    return ((flagX ^ flagR) & 0x10) << 1;
+}
+
+uint8_t CPU::CARRY_F() {
+    if (flags == EAGER) return AF & CARRY;
+    if (flags >= INCREMENTED) return flagC;
+    return (flagR >> 4) & CARRY;
+}
+
+void CPU::syncFlags() {
+    if (flags != EAGER) {
+        F = ZERO_F() | SUB_F() | HALF_F() | CARRY_F();
+        flags = EAGER;
+    }
+}
+
+// Instructions that read or write F directly instead of through the flag accessors
+static bool touchesF(uint8_t opcode) {
+    switch (opcode) {
+        case 0x07: case 0x0F: case 0x17: case 0x1F: // Rotate A
+        case 0x27: case 0x2F: case 0x37: case 0x3F: // DAA, CPL, SCF, CCF
+        case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL,rr
+        case 0xE6: case 0xEE: case 0xF6:            // AND, XOR, OR n
+        case 0xE8: case 0xF8:                       // ADD SP,e and LD HL,SP+e
+        case 0xF1: case 0xF5:                       // POP AF, PUSH AF
+        case 0xCB:
+            return true;
+        default:
+            return opcode >= 0xA0 && opcode <= 0xB7; // AND, XOR, OR r
+    }
+}
+#else
 uint8_t CPU::ZERO_F() { return AF & ZERO; }
 uint8_t CPU::SUB_F() { return AF & NEG; }
 uint8_t CPU::HALF_F() { return AF & HALF; }
 uint8_t CPU::CARRY_F() { return AF & CARRY; }
 
+void CPU::syncFlags() {}
+#endif
+
+// Snapshot for debuggers and test runners, with F brought up to date
+Registers CPU::registers() {
+    syncFlags();
+    return {AF, BC, DE, HL, SP, PC};
+}
+
+// Flags are synced first, so states are the same with and without LAZY_FLAGS
+void CPU::serialize(State& state) {
+    syncFlags();
+    state.value(AF);
+    state.value(BC);
+    state.value(DE);
+    state.value(HL);
+    state.value(SP);
+    state.value(PC);
+    state.value(opcode);
+    state.value(totalCycles);
+    state.value(halted);
+    state.value(haltBug);
+    state.value(IRQ);
+    state.value(IME);
+    state.value(interrupt);
+    state.value(run);
+    operand = nullptr;
+}
+
 
 // Set flag
 uint8_t CPU::ZERO_S(uint16_t n) {
@@ -128,18 +240,47 @@ uint8_t CPU::CARRY_Sbc(uint8_t a, uint8_t b) {
 }
 
 uint8_t CPU::read(uint16_t address) {
-    uint8_t n = memory.read(address);
+    uint8_t* page = memory.readMap[address >> 8];
+    uint8_t n = page ? page[address & 0xFF] : memory.read(address);
     tick();
     return n;
 }
 
 void CPU::write(uint16_t address, uint8_t n) {
-    memory.write(address, n);
+    uint8_t* page = memory.writeMap[address >> 8];
+    if (page) {
+        page[address & 0xFF] = n;
+    } else {
+        memory.write(address, n);
+    }
     tick();
 }
 
+// Cached ROM blocks hand out pre-decoded opcodes, everything else is read from memory
+void CPU::fetch() {
+#ifdef BLOCK_CACHE
+    const BlockCache::Op* op = memory.blocks.next(PC);
+    operand = nullptr;
+    if (op) {
+        PC++;
+        tick();
+        opcode = op->opcode;
+        operand = op->operand;
+        return;
+    }
+#endif
+    opcode = readByte();
+}
+
 // Read memory
 uint8_t CPU::readByte() {
+#ifdef BLOCK_CACHE
+    if (operand) {
+        PC++;
+        tick();
+        return *operand++;
+    }
+#endif
     return read(PC++);
 }
 
@@ -164,30 +305,74 @@ uint16_t CPU::pop() {
 
 // ADD
 void CPU::ADD(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    flags = ADDED;
+    flagX = A ^ n;
+    flagR = A + n;
+    A = flagR;
+#elif defined(ALU_TABLES)
+    F = alu.add[0][A][n];
+    A += n;
+#else
     uint8_t a = A;
     A += n;
     F = ZERO_S(A) | HALF_S(a, n) | CARRY_S(a, n);
+#endif
 }
 
 // ADC
 void CPU::ADC(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    uint8_t c = CARRY_F() >> 4;
+    flags = ADDED;
+    flagX = A ^ n;
+    flagR = A + n + c;
+    A = flagR;
+#elif defined(ALU_TABLES)
+    uint8_t c = CARRY_F() >> 4;
+    F = alu.add[c][A][n];
+    A += n + c;
+#else
     uint8_t a = A;
     A += n+(CARRY_F() >> 4);
     F = ZERO_S(A) | HALF_Sc(a, n) | CARRY_Sc(a, n);
+#endif
 }
 
 // SUB
 void CPU::SUB(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    flags = SUBTRACTED;
+    flagX = A ^ n;
+    flagR = A - n;
+    A = flagR;
+#elif defined(ALU_TABLES)
+    F = alu.sub[0][A][n];
+    A -= n;
+#else
     uint8_t a = A;
     A -= n;
     F = ZERO_S(A) | NEG | HALF_Sb(a, n) | CARRY_Sb(a, n);
+#endif
 }
 
 // SBC
 void CPU::SBC(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    uint8_t c = CARRY_F() >> 4;
+    flags = SUBTRACTED;
+    flagX = A ^ n;
+    flagR = A - n - c;
+    A = flagR;
+#elif defined(ALU_TABLES)
+    uint8_t c = CARRY_F() >> 4;
+    F = alu.sub[c][A][n];
+    A -= n + c;
+#else
     uint8_t a = A;
     A = A-n-(CARRY_F() >> 4);
     F = ZERO_S(A) | NEG | HALF_Sbc(a, n) | CARRY_Sbc(a, n);
+#endif
 }
 
 // AND
@@ -210,17 +395,43 @@ void CPU::XOR(uint8_t n) {
 
 // CP
 void CPU::CP(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    flags = SUBTRACTED;
+    flagX = A ^ n;
+    flagR = A - n;
+#elif defined(ALU_TABLES)
+    F = alu.sub[0][A][n];
+#else
     F = ZERO_S(A-n) | NEG | HALF_Sb(A, n) | CARRY_Sb(A, n);
+#endif
 }
 
 // INC
 void CPU::INC(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    flagC = CARRY_F();
+    flags = INCREMENTED;
+    flagX = (n - 1) ^ 1;
+    flagR = n;
+#elif defined(ALU_TABLES)
+    F = alu.inc[n] | CARRY_F();
+#else
     F = ZERO_S(n) | (((n & 0x0F) == 0) ? HALF : 0) | CARRY_F();
+#endif
 }
 
 // DEC
 void CPU::DEC(uint8_t n) {
+#if defined(LAZY_FLAGS)
+    flagC = CARRY_F();
+    flags = DECREMENTED;
+    flagX = n ^ 1;
+    flagR = n - 1;
+#elif defined(ALU_TABLES)
+    F = alu.dec[n] | CARRY_F();
+#else
     F = ZERO_S(n-1) | NEG | (((n >> 4) > ((n-1) >> 4)) ? HALF : 0) | CARRY_F();
+#endif
 }
 
 // ADD nn
@@ -257,6 +468,56 @@ void CPU::RRA() {
     F = (a & 0x1) << 4;
 }
 
+#ifdef ALU_TABLES
+// Rotate and shift through the table, the result lands in the high byte
+uint8_t CPU::RLC(uint8_t n) {
+    uint16_t r = alu.shift[ALU::RLC][0][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::RL(uint8_t n) {
+    uint16_t r = alu.shift[ALU::RL][CARRY_F() >> 4][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::RRC(uint8_t n) {
+    uint16_t r = alu.shift[ALU::RRC][0][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::RR(uint8_t n) {
+    uint16_t r = alu.shift[ALU::RR][CARRY_F() >> 4][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::SLA(uint8_t n) {
+    uint16_t r = alu.shift[ALU::SLA][0][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::SRA(uint8_t n) {
+    uint16_t r = alu.shift[ALU::SRA][0][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::SRL(uint8_t n) {
+    uint16_t r = alu.shift[ALU::SRL][0][n];
+    F = r;
+    return r >> 8;
+}
+
+uint8_t CPU::SWAP(uint8_t n) {
+    uint16_t r = alu.shift[ALU::SWAP][0][n];
+    F = r;
+    return r >> 8;
+}
+#else
 // Rotate left
 uint8_t CPU::RLC(uint8_t n) {
     n = (n << 1) | (n >> 7);
@@ -315,6 +576,8 @@ uint8_t CPU::SWAP(uint8_t n) {
     return (n << 4) | (n >> 4);
 }
 
+#endif
+
 // BIT
 void CPU::BIT(uint8_t n, uint8_t b) {
     F = ZERO_S(n & (1 << b)) | HALF | CARRY_F();
@@ -365,13 +628,8 @@ void CPU::RET(bool flag) {
     }
 }
 
-void CPU::cycle() {
-
-    uint8_t n;
-    uint16_t nn;
-    int8_t e;
-    uint8_t interrupt;
-
+// Returns false while the CPU stays halted
+bool CPU::interrupts() {
     if (IRQ != 0 && --IRQ == 0) {
         IME = 1;
     }
@@ -381,6 +639,7 @@ void CPU::cycle() {
         memory.interrupt(0x10);
     }
 
+    memory.interruptsChanged = false;
     interrupt = memory.read(IF) & memory.read(IE) & 0x1F;
 
     if (halted) {
@@ -388,8 +647,12 @@ void CPU::cycle() {
             halted = 0;
             tick();
         } else {
-            tick();
-            return;
+            // Nothing can wake the CPU before the next event
+            uint64_t wake = std::min(scheduler.next, scheduler.cycles + 456);
+            do {
+                tick();
+            } while (scheduler.cycles < wake);
+            return false;
         }
     }
 
@@ -416,803 +679,932 @@ void CPU::cycle() {
         }
         tick();
     }
+    return true;
+}
 
-    opcode = readByte();
+// Runs one instruction. The threaded core goes on with the ones after it until an
+// event fires, something needs the interrupt check or the cycle count reaches limit.
+void CPU::cycle(uint64_t limit) {
+    this->limit = limit;
+    dispatched = false;
+#ifdef THREADED
+    // IF, IE, IME and HALT are unchanged since the last check, nothing new to service
+    bool check = IRQ != 0 || halted || memory.interruptsChanged || memory.joypad.interrupt;
+#else
+    bool check = true;
+#endif
+    if (check && !interrupts()) {
+        return;
+    }
+
+#ifdef JIT
+    if (jit.enabled && !haltBug && jit.run()) {
+        return;
+    }
+    // Back to the JIT after one instruction
+    if (jit.enabled) {
+        this->limit = 0;
+    }
+#endif
+
+    fetch();
 
     if (haltBug) {
         haltBug = 0;
         --PC;
+        operand = nullptr;
     }
 
+    execute();
+}
+
+// Runs the fetched opcode
+void CPU::execute() {
+#ifdef THREADED
+    // Handler labels indexed by opcode, gaps are the unused opcodes
+    static void* const OPS[256] = {
+        &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+        &&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+        &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+        &&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+        &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+        &&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+        &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+        &&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+        &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+        &&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+        &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+        &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+        &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+        &&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+        &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+        &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+        &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+        &&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+        &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+        &&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+        &&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7,
+        &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+        &&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7,
+        &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+        &&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7,
+        &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+        &&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_default, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7,
+        &&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_default, &&op_0xDC, &&op_default, &&op_0xDE, &&op_0xDF,
+        &&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_default, &&op_default, &&op_0xE5, &&op_0xE6, &&op_0xE7,
+        &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_default, &&op_default, &&op_default, &&op_0xEE, &&op_0xEF,
+        &&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_default, &&op_0xF5, &&op_0xF6, &&op_0xF7,
+        &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_default, &&op_default, &&op_0xFE, &&op_0xFF,
+    };
+    static void* const CB_OPS[256] = {
+        &&cb_0x00, &&cb_0x01, &&cb_0x02, &&cb_0x03, &&cb_0x04, &&cb_0x05, &&cb_0x06, &&cb_0x07,
+        &&cb_0x08, &&cb_0x09, &&cb_0x0A, &&cb_0x0B, &&cb_0x0C, &&cb_0x0D, &&cb_0x0E, &&cb_0x0F,
+        &&cb_0x10, &&cb_0x11, &&cb_0x12, &&cb_0x13, &&cb_0x14, &&cb_0x15, &&cb_0x16, &&cb_0x17,
+        &&cb_0x18, &&cb_0x19, &&cb_0x1A, &&cb_0x1B, &&cb_0x1C, &&cb_0x1D, &&cb_0x1E, &&cb_0x1F,
+        &&cb_0x20, &&cb_0x21, &&cb_0x22, &&cb_0x23, &&cb_0x24, &&cb_0x25, &&cb_0x26, &&cb_0x27,
+        &&cb_0x28, &&cb_0x29, &&cb_0x2A, &&cb_0x2B, &&cb_0x2C, &&cb_0x2D, &&cb_0x2E, &&cb_0x2F,
+        &&cb_0x30, &&cb_0x31, &&cb_0x32, &&cb_0x33, &&cb_0x34, &&cb_0x35, &&cb_0x36, &&cb_0x37,
+        &&cb_0x38, &&cb_0x39, &&cb_0x3A, &&cb_0x3B, &&cb_0x3C, &&cb_0x3D, &&cb_0x3E, &&cb_0x3F,
+        &&cb_0x40, &&cb_0x41, &&cb_0x42, &&cb_0x43, &&cb_0x44, &&cb_0x45, &&cb_0x46, &&cb_0x47,
+        &&cb_0x48, &&cb_0x49, &&cb_0x4A, &&cb_0x4B, &&cb_0x4C, &&cb_0x4D, &&cb_0x4E, &&cb_0x4F,
+        &&cb_0x50, &&cb_0x51, &&cb_0x52, &&cb_0x53, &&cb_0x54, &&cb_0x55, &&cb_0x56, &&cb_0x57,
+        &&cb_0x58, &&cb_0x59, &&cb_0x5A, &&cb_0x5B, &&cb_0x5C, &&cb_0x5D, &&cb_0x5E, &&cb_0x5F,
+        &&cb_0x60, &&cb_0x61, &&cb_0x62, &&cb_0x63, &&cb_0x64, &&cb_0x65, &&cb_0x66, &&cb_0x67,
+        &&cb_0x68, &&cb_0x69, &&cb_0x6A, &&cb_0x6B, &&cb_0x6C, &&cb_0x6D, &&cb_0x6E, &&cb_0x6F,
+        &&cb_0x70, &&cb_0x71, &&cb_0x72, &&cb_0x73, &&cb_0x74, &&cb_0x75, &&cb_0x76, &&cb_0x77,
+        &&cb_0x78, &&cb_0x79, &&cb_0x7A, &&cb_0x7B, &&cb_0x7C, &&cb_0x7D, &&cb_0x7E, &&cb_0x7F,
+        &&cb_0x80, &&cb_0x81, &&cb_0x82, &&cb_0x83, &&cb_0x84, &&cb_0x85, &&cb_0x86, &&cb_0x87,
+        &&cb_0x88, &&cb_0x89, &&cb_0x8A, &&cb_0x8B, &&cb_0x8C, &&cb_0x8D, &&cb_0x8E, &&cb_0x8F,
+        &&cb_0x90, &&cb_0x91, &&cb_0x92, &&cb_0x93, &&cb_0x94, &&cb_0x95, &&cb_0x96, &&cb_0x97,
+        &&cb_0x98, &&cb_0x99, &&cb_0x9A, &&cb_0x9B, &&cb_0x9C, &&cb_0x9D, &&cb_0x9E, &&cb_0x9F,
+        &&cb_0xA0, &&cb_0xA1, &&cb_0xA2, &&cb_0xA3, &&cb_0xA4, &&cb_0xA5, &&cb_0xA6, &&cb_0xA7,
+        &&cb_0xA8, &&cb_0xA9, &&cb_0xAA, &&cb_0xAB, &&cb_0xAC, &&cb_0xAD, &&cb_0xAE, &&cb_0xAF,
+        &&cb_0xB0, &&cb_0xB1, &&cb_0xB2, &&cb_0xB3, &&cb_0xB4, &&cb_0xB5, &&cb_0xB6, &&cb_0xB7,
+        &&cb_0xB8, &&cb_0xB9, &&cb_0xBA, &&cb_0xBB, &&cb_0xBC, &&cb_0xBD, &&cb_0xBE, &&cb_0xBF,
+        &&cb_0xC0, &&cb_0xC1, &&cb_0xC2, &&cb_0xC3, &&cb_0xC4, &&cb_0xC5, &&cb_0xC6, &&cb_0xC7,
+        &&cb_0xC8, &&cb_0xC9, &&cb_0xCA, &&cb_0xCB, &&cb_0xCC, &&cb_0xCD, &&cb_0xCE, &&cb_0xCF,
+        &&cb_0xD0, &&cb_0xD1, &&cb_0xD2, &&cb_0xD3, &&cb_0xD4, &&cb_0xD5, &&cb_0xD6, &&cb_0xD7,
+        &&cb_0xD8, &&cb_0xD9, &&cb_0xDA, &&cb_0xDB, &&cb_0xDC, &&cb_0xDD, &&cb_0xDE, &&cb_0xDF,
+        &&cb_0xE0, &&cb_0xE1, &&cb_0xE2, &&cb_0xE3, &&cb_0xE4, &&cb_0xE5, &&cb_0xE6, &&cb_0xE7,
+        &&cb_0xE8, &&cb_0xE9, &&cb_0xEA, &&cb_0xEB, &&cb_0xEC, &&cb_0xED, &&cb_0xEE, &&cb_0xEF,
+        &&cb_0xF0, &&cb_0xF1, &&cb_0xF2, &&cb_0xF3, &&cb_0xF4, &&cb_0xF5, &&cb_0xF6, &&cb_0xF7,
+        &&cb_0xF8, &&cb_0xF9, &&cb_0xFA, &&cb_0xFB, &&cb_0xFC, &&cb_0xFD, &&cb_0xFE, &&cb_0xFF,
+    };
+#endif
+
+#ifndef ALU_TABLES
+    uint8_t n;
+#endif
+    uint16_t nn;
+    int8_t e;
+
+#ifdef THREADED
+start:
+#endif
+#ifdef LAZY_FLAGS
+    if (flags != EAGER && touchesF(opcode)) {
+        syncFlags();
+    }
+#endif
+
+#ifdef THREADED
+    goto *OPS[opcode];
+#endif
     switch (opcode) {
         // 8-Bit Transfer and Input/Output Instructions
         // LD A,r
-        case 0x78: A = B; break;
-        case 0x79: A = C; break;
-        case 0x7A: A = D; break;
-        case 0x7B: A = E; break;
-        case 0x7C: A = H; break;
-        case 0x7D: A = L; break;
-        case 0x7F: break;
+        OP(0x78): A = B; NEXT;
+        OP(0x79): A = C; NEXT;
+        OP(0x7A): A = D; NEXT;
+        OP(0x7B): A = E; NEXT;
+        OP(0x7C): A = H; NEXT;
+        OP(0x7D): A = L; NEXT;
+        OP(0x7F): NEXT;
 
         // LD B,r
-        case 0x40: break;
-        case 0x41: B = C; break;
-        case 0x42: B = D; break;
-        case 0x43: B = E; break;
-        case 0x44: B = H; break;
-        case 0x45: B = L; break;
-        case 0x47: B = A; break;
+        OP(0x40): NEXT;
+        OP(0x41): B = C; NEXT;
+        OP(0x42): B = D; NEXT;
+        OP(0x43): B = E; NEXT;
+        OP(0x44): B = H; NEXT;
+        OP(0x45): B = L; NEXT;
+        OP(0x47): B = A; NEXT;
 
         // LD C,r
-        case 0x48: C = B; break;
-        case 0x49: break;
-        case 0x4A: C = D; break;
-        case 0x4B: C = E; break;
-        case 0x4C: C = H; break;
-        case 0x4D: C = L; break;
-        case 0x4F: C = A; break;
+        OP(0x48): C = B; NEXT;
+        OP(0x49): NEXT;
+        OP(0x4A): C = D; NEXT;
+        OP(0x4B): C = E; NEXT;
+        OP(0x4C): C = H; NEXT;
+        OP(0x4D): C = L; NEXT;
+        OP(0x4F): C = A; NEXT;
 
         // LD D,r
-        case 0x50: D = B; break;
-        case 0x51: D = C; break;
-        case 0x52: break;
-        case 0x53: D = E; break;
-        case 0x54: D = H; break;
-        case 0x55: D = L; break;
-        case 0x57: D = A; break;
+        OP(0x50): D = B; NEXT;
+        OP(0x51): D = C; NEXT;
+        OP(0x52): NEXT;
+        OP(0x53): D = E; NEXT;
+        OP(0x54): D = H; NEXT;
+        OP(0x55): D = L; NEXT;
+        OP(0x57): D = A; NEXT;
 
         // LD E,r
-        case 0x58: E = B; break;
-        case 0x59: E = C; break;
-        case 0x5A: E = D; break;
-        case 0x5B: break;
-        case 0x5C: E = H; break;
-        case 0x5D: E = L; break;
-        case 0x5F: E = A; break;
+        OP(0x58): E = B; NEXT;
+        OP(0x59): E = C; NEXT;
+        OP(0x5A): E = D; NEXT;
+        OP(0x5B): NEXT;
+        OP(0x5C): E = H; NEXT;
+        OP(0x5D): E = L; NEXT;
+        OP(0x5F): E = A; NEXT;
 
         // LD H,r
-        case 0x60: H = B; break;
-        case 0x61: H = C; break;
-        case 0x62: H = D; break;
-        case 0x63: H = E; break;
-        case 0x64: break;
-        case 0x65: H = L; break;
-        case 0x67: H = A; break;
+        OP(0x60): H = B; NEXT;
+        OP(0x61): H = C; NEXT;
+        OP(0x62): H = D; NEXT;
+        OP(0x63): H = E; NEXT;
+        OP(0x64): NEXT;
+        OP(0x65): H = L; NEXT;
+        OP(0x67): H = A; NEXT;
         
         // LD L,r
-        case 0x68: L = B; break;
-        case 0x69: L = C; break;
-        case 0x6A: L = D; break;
-        case 0x6B: L = E; break;
-        case 0x6C: L = H; break;
-        case 0x6D: break;
-        case 0x6F: L = A; break;
+        OP(0x68): L = B; NEXT;
+        OP(0x69): L = C; NEXT;
+        OP(0x6A): L = D; NEXT;
+        OP(0x6B): L = E; NEXT;
+        OP(0x6C): L = H; NEXT;
+        OP(0x6D): NEXT;
+        OP(0x6F): L = A; NEXT;
 
         // LD r,n
-        case 0x06: B = readByte(); break;
-        case 0x0E: C = readByte(); break;
-        case 0x16: D = readByte(); break;
-        case 0x1E: E = readByte(); break;
-        case 0x26: H = readByte(); break;
-        case 0x2E: L = readByte(); break;
-        case 0x3E: A = readByte(); break;
+        OP(0x06): B = readByte(); NEXT;
+        OP(0x0E): C = readByte(); NEXT;
+        OP(0x16): D = readByte(); NEXT;
+        OP(0x1E): E = readByte(); NEXT;
+        OP(0x26): H = readByte(); NEXT;
+        OP(0x2E): L = readByte(); NEXT;
+        OP(0x3E): A = readByte(); NEXT;
 
         // LD r,(HL)
-        case 0x46: B = read(HL); break;
-        case 0x4E: C = read(HL); break;
-        case 0x56: D = read(HL); break;
-        case 0x5E: E = read(HL); break;
-        case 0x66: H = read(HL); break;
-        case 0x6E: L = read(HL); break;
-        case 0x7E: A = read(HL); break;
+        OP(0x46): B = read(HL); NEXT;
+        OP(0x4E): C = read(HL); NEXT;
+        OP(0x56): D = read(HL); NEXT;
+        OP(0x5E): E = read(HL); NEXT;
+        OP(0x66): H = read(HL); NEXT;
+        OP(0x6E): L = read(HL); NEXT;
+        OP(0x7E): A = read(HL); NEXT;
 
         // LD (HL),r
-        case 0x70: write(HL, B); break;
-        case 0x71: write(HL, C); break;
-        case 0x72: write(HL, D); break;
-        case 0x73: write(HL, E); break;
-        case 0x74: write(HL, H); break;
-        case 0x75: write(HL, L); break;
-        case 0x77: write(HL, A); break;
+        OP(0x70): write(HL, B); NEXT;
+        OP(0x71): write(HL, C); NEXT;
+        OP(0x72): write(HL, D); NEXT;
+        OP(0x73): write(HL, E); NEXT;
+        OP(0x74): write(HL, H); NEXT;
+        OP(0x75): write(HL, L); NEXT;
+        OP(0x77): write(HL, A); NEXT;
 
         // LD (HL),n
-        case 0x36: write(HL, readByte()); break;
+        OP(0x36): write(HL, readByte()); NEXT;
 
         // LD A,(BC)
-        case 0x0A: A = read(BC); break;
+        OP(0x0A): A = read(BC); NEXT;
 
         // LD A,(DE)
-        case 0x1A: A = read(DE); break;
+        OP(0x1A): A = read(DE); NEXT;
             
         // LD A,(C)
-        case 0xF2: A = read(0xFF00 | C); break;
+        OP(0xF2): A = read(0xFF00 | C); NEXT;
 
         // LD (C),A
-        case 0xE2: write(0xFF00 | C, A); break;
+        OP(0xE2): write(0xFF00 | C, A); NEXT;
 
         // LDH A,(n)
-        case 0xF0: A = read(0xFF00 | readByte()); break;
+        OP(0xF0): A = read(0xFF00 | readByte()); NEXT;
 
         // LDH (n),A
-        case 0xE0: write(0xFF00 | readByte(), A); break;
+        OP(0xE0): write(0xFF00 | readByte(), A); NEXT;
 
         // LD A,(nn)
-        case 0xFA: A = read(readb16()); break;
+        OP(0xFA): A = read(readb16()); NEXT;
 
         // LD (nn),A
-        case 0xEA: write(readb16(), A); break;
+        OP(0xEA): write(readb16(), A); NEXT;
 
         // LD A,(HLI)
-        case 0x2A: A = read(HL++); break;
+        OP(0x2A): A = read(HL++); NEXT;
 
         // LD A,(HLD)
-        case 0x3A: A = read(HL--); break;
+        OP(0x3A): A = read(HL--); NEXT;
 
         // LD (BC),A
-        case 0x02: write(BC, A); break;
+        OP(0x02): write(BC, A); NEXT;
 
         // LD (DE),A
-        case 0x12: write(DE, A); break;
+        OP(0x12): write(DE, A); NEXT;
 
         // LD (HLI),A
-        case 0x22: write(HL++, A); break;
+        OP(0x22): write(HL++, A); NEXT;
 
         // LD (HLD),A
-        case 0x32: write(HL--, A); break;
+        OP(0x32): write(HL--, A); NEXT;
 
         // 16-Bit Transfer Instructions
         // LD dd,nn
-        case 0x01: BC = readb16(); break;
-        case 0x11: DE = readb16(); break;
-        case 0x21: HL = readb16(); break;
-        case 0x31: SP = readb16(); break;
+        OP(0x01): BC = readb16(); NEXT;
+        OP(0x11): DE = readb16(); NEXT;
+        OP(0x21): HL = readb16(); NEXT;
+        OP(0x31): SP = readb16(); NEXT;
 
         // LD SP,HL
-        case 0xF9: SP = HL; tick(); break;
+        OP(0xF9): SP = HL; tick(); NEXT;
 
         // PUSH nn
-        case 0xC5: push(BC); break;
-        case 0xD5: push(DE); break;
-        case 0xE5: push(HL); break;
-        case 0xF5: push(AF); break;
+        OP(0xC5): push(BC); NEXT;
+        OP(0xD5): push(DE); NEXT;
+        OP(0xE5): push(HL); NEXT;
+        OP(0xF5): push(AF); NEXT;
 
         // POP nn
-        case 0xC1: BC = pop(); break;
-        case 0xD1: DE = pop(); break;
-        case 0xE1: HL = pop(); break;
-        case 0xF1: AF = pop() & 0xFFF0; break;
+        OP(0xC1): BC = pop(); NEXT;
+        OP(0xD1): DE = pop(); NEXT;
+        OP(0xE1): HL = pop(); NEXT;
+        OP(0xF1): AF = pop() & 0xFFF0; NEXT;
 
         // LDHL SP,e
-        case 0xF8:
+        OP(0xF8):
             e = readByte();
             HL = SP + e;
             F = HALF_S(SP, e) | CARRY_S(SP, e);
             tick();
-            break;
+            NEXT;
 
         // LD (nn),SP
-        case 0x08:
+        OP(0x08):
             nn = readb16();
             write(nn, SP & 0x00FF);
             write(nn+1, SP >> 8);
-            break;
+            NEXT;
 
         // 8-Bit Arithmetic and Logical Operation Instructions
         // ADD A,r
-        case 0x80: ADD(B); break;
-        case 0x81: ADD(C); break;
-        case 0x82: ADD(D); break;
-        case 0x83: ADD(E); break;
-        case 0x84: ADD(H); break;
-        case 0x85: ADD(L); break;
-        case 0x87: ADD(A); break;
+        OP(0x80): ADD(B); NEXT;
+        OP(0x81): ADD(C); NEXT;
+        OP(0x82): ADD(D); NEXT;
+        OP(0x83): ADD(E); NEXT;
+        OP(0x84): ADD(H); NEXT;
+        OP(0x85): ADD(L); NEXT;
+        OP(0x87): ADD(A); NEXT;
 
         // ADD A,n
-        case 0xC6: ADD(readByte()); break;
+        OP(0xC6): ADD(readByte()); NEXT;
 
         // ADD A,(HL)
-        case 0x86: ADD(read(HL)); break;
+        OP(0x86): ADD(read(HL)); NEXT;
 
         // ADC A,r
-        case 0x88: ADC(B); break;
-        case 0x89: ADC(C); break;
-        case 0x8A: ADC(D); break;
-        case 0x8B: ADC(E); break;
-        case 0x8C: ADC(H); break;
-        case 0x8D: ADC(L); break;
-        case 0x8F: ADC(A); break;
+        OP(0x88): ADC(B); NEXT;
+        OP(0x89): ADC(C); NEXT;
+        OP(0x8A): ADC(D); NEXT;
+        OP(0x8B): ADC(E); NEXT;
+        OP(0x8C): ADC(H); NEXT;
+        OP(0x8D): ADC(L); NEXT;
+        OP(0x8F): ADC(A); NEXT;
 
         // ADC A,n
-        case 0xCE: ADC(readByte()); break;
+        OP(0xCE): ADC(readByte()); NEXT;
 
         // ADC A,(HL)
-        case 0x8E: ADC(read(HL)); break;
+        OP(0x8E): ADC(read(HL)); NEXT;
 
         // SUB r
-        case 0x90: SUB(B); break;
-        case 0x91: SUB(C); break;
-        case 0x92: SUB(D); break;
-        case 0x93: SUB(E); break;
-        case 0x94: SUB(H); break;
-        case 0x95: SUB(L); break;
-        case 0x97: SUB(A); break;
+        OP(0x90): SUB(B); NEXT;
+        OP(0x91): SUB(C); NEXT;
+        OP(0x92): SUB(D); NEXT;
+        OP(0x93): SUB(E); NEXT;
+        OP(0x94): SUB(H); NEXT;
+        OP(0x95): SUB(L); NEXT;
+        OP(0x97): SUB(A); NEXT;
 
         // SUB n
-        case 0xD6: SUB(readByte()); break;
+        OP(0xD6): SUB(readByte()); NEXT;
 
         // SUB (HL)
-        case 0x96: SUB(read(HL)); break;
+        OP(0x96): SUB(read(HL)); NEXT;
 
         // SBC r
-        case 0x98: SBC(B); break;
-        case 0x99: SBC(C); break;
-        case 0x9A: SBC(D); break;
-        case 0x9B: SBC(E); break;
-        case 0x9C: SBC(H); break;
-        case 0x9D: SBC(L); break;
-        case 0x9F: SBC(A); break;
+        OP(0x98): SBC(B); NEXT;
+        OP(0x99): SBC(C); NEXT;
+        OP(0x9A): SBC(D); NEXT;
+        OP(0x9B): SBC(E); NEXT;
+        OP(0x9C): SBC(H); NEXT;
+        OP(0x9D): SBC(L); NEXT;
+        OP(0x9F): SBC(A); NEXT;
 
         // SBC n
-        case 0xDE: SBC(readByte()); break;
+        OP(0xDE): SBC(readByte()); NEXT;
 
         // SBC (HL)
-        case 0x9E: SBC(read(HL)); break;
+        OP(0x9E): SBC(read(HL)); NEXT;
 
         // AND r
-        case 0xA0: AND(B); break;
-        case 0xA1: AND(C); break;
-        case 0xA2: AND(D); break;
-        case 0xA3: AND(E); break;
-        case 0xA4: AND(H); break;
-        case 0xA5: AND(L); break;
-        case 0xA7: AND(A); break;
+        OP(0xA0): AND(B); NEXT;
+        OP(0xA1): AND(C); NEXT;
+        OP(0xA2): AND(D); NEXT;
+        OP(0xA3): AND(E); NEXT;
+        OP(0xA4): AND(H); NEXT;
+        OP(0xA5): AND(L); NEXT;
+        OP(0xA7): AND(A); NEXT;
 
         // AND n
-        case 0xE6: AND(readByte()); break;
+        OP(0xE6): AND(readByte()); NEXT;
 
         // AND (HL)
-        case 0xA6: AND(read(HL)); break;
+        OP(0xA6): AND(read(HL)); NEXT;
 
         // OR r
-        case 0xB0: OR(B); break;
-        case 0xB1: OR(C); break;
-        case 0xB2: OR(D); break;
-        case 0xB3: OR(E); break;
-        case 0xB4: OR(H); break;
-        case 0xB5: OR(L); break;
-        case 0xB7: OR(A); break;
+        OP(0xB0): OR(B); NEXT;
+        OP(0xB1): OR(C); NEXT;
+        OP(0xB2): OR(D); NEXT;
+        OP(0xB3): OR(E); NEXT;
+        OP(0xB4): OR(H); NEXT;
+        OP(0xB5): OR(L); NEXT;
+        OP(0xB7): OR(A); NEXT;
 
         // OR n
-        case 0xF6: OR(readByte()); break;
+        OP(0xF6): OR(readByte()); NEXT;
 
         // OR (HL)
-        case 0xB6: OR(read(HL)); break;
+        OP(0xB6): OR(read(HL)); NEXT;
 
         // XOR r
-        case 0xA8: XOR(B); break;
-        case 0xA9: XOR(C); break;
-        case 0xAA: XOR(D); break;
-        case 0xAB: XOR(E); break;
-        case 0xAC: XOR(H); break;
-        case 0xAD: XOR(L); break;
-        case 0xAF: XOR(A); break;
+        OP(0xA8): XOR(B); NEXT;
+        OP(0xA9): XOR(C); NEXT;
+        OP(0xAA): XOR(D); NEXT;
+        OP(0xAB): XOR(E); NEXT;
+        OP(0xAC): XOR(H); NEXT;
+        OP(0xAD): XOR(L); NEXT;
+        OP(0xAF): XOR(A); NEXT;
 
         // XOR n
-        case 0xEE: XOR(readByte()); break;
+        OP(0xEE): XOR(readByte()); NEXT;
 
         // XOR (HL)
-        case 0xAE: XOR(read(HL)); break;
+        OP(0xAE): XOR(read(HL)); NEXT;
 
         // CP r
-        case 0xB8: CP(B); break;
-        case 0xB9: CP(C); break;
-        case 0xBA: CP(D); break;
-        case 0xBB: CP(E); break;
-        case 0xBC: CP(H); break;
-        case 0xBD: CP(L); break;
-        case 0xBF: CP(A); break;
+        OP(0xB8): CP(B); NEXT;
+        OP(0xB9): CP(C); NEXT;
+        OP(0xBA): CP(D); NEXT;
+        OP(0xBB): CP(E); NEXT;
+        OP(0xBC): CP(H); NEXT;
+        OP(0xBD): CP(L); NEXT;
+        OP(0xBF): CP(A); NEXT;
 
         // CP n
-        case 0xFE: CP(readByte()); break;
+        OP(0xFE): CP(readByte()); NEXT;
 
         // CP (HL)
-        case 0xBE: CP(read(HL)); break;
+        OP(0xBE): CP(read(HL)); NEXT;
 
         // INC,r
-        case 0x04: B++; INC(B); break;
-        case 0x0C: C++; INC(C); break;
-        case 0x14: D++; INC(D); break;
-        case 0x1C: E++; INC(E); break;
-        case 0x24: H++; INC(H); break;
-        case 0x2C: L++; INC(L); break;
-        case 0x3C: A++; INC(A); break;
+        OP(0x04): B++; INC(B); NEXT;
+        OP(0x0C): C++; INC(C); NEXT;
+        OP(0x14): D++; INC(D); NEXT;
+        OP(0x1C): E++; INC(E); NEXT;
+        OP(0x24): H++; INC(H); NEXT;
+        OP(0x2C): L++; INC(L); NEXT;
+        OP(0x3C): A++; INC(A); NEXT;
 
         // INC,(HL)
-        case 0x34: write(HL, read(HL)+1); INC(memory.read(HL)); break;
+        OP(0x34): write(HL, read(HL)+1); INC(memory.read(HL)); NEXT;
 
         // DEC,r
-        case 0x05: DEC(B); B--; break;
-        case 0x0D: DEC(C); C--; break;
-        case 0x15: DEC(D); D--; break;
-        case 0x1D: DEC(E); E--; break;
-        case 0x25: DEC(H); H--; break;
-        case 0x2D: DEC(L); L--; break;
-        case 0x3D: DEC(A); A--; break;
+        OP(0x05): DEC(B); B--; NEXT;
+        OP(0x0D): DEC(C); C--; NEXT;
+        OP(0x15): DEC(D); D--; NEXT;
+        OP(0x1D): DEC(E); E--; NEXT;
+        OP(0x25): DEC(H); H--; NEXT;
+        OP(0x2D): DEC(L); L--; NEXT;
+        OP(0x3D): DEC(A); A--; NEXT;
 
         // DEC,(HL)
-        case 0x35: DEC(memory.read(HL)); write(HL, read(HL)-1); break;
+        OP(0x35): DEC(memory.read(HL)); write(HL, read(HL)-1); NEXT;
 
         // 16-Bit Arithmetic Operation Instructions
         // ADD HL,BC
-        case 0x09: ADD_nn(BC); break;
+        OP(0x09): ADD_nn(BC); NEXT;
 
         // ADD HL,DE
-        case 0x19: ADD_nn(DE); break;
+        OP(0x19): ADD_nn(DE); NEXT;
 
         // ADD HL,HL
-        case 0x29: ADD_nn(HL); break;
+        OP(0x29): ADD_nn(HL); NEXT;
 
         // ADD HL,SP
-        case 0x39: ADD_nn(SP); break;
+        OP(0x39): ADD_nn(SP); NEXT;
 
         // ADD SP,e
-        case 0xE8:
+        OP(0xE8):
             e = readByte();
             F = HALF_S(SP, e) | CARRY_S(SP, e);
             SP += e;
             tick();
             tick();
-            break;
+            NEXT;
 
         // INC BC
-        case 0x03: BC++; tick(); break;
+        OP(0x03): BC++; tick(); NEXT;
 
         // INC DE
-        case 0x13: DE++; tick(); break;
+        OP(0x13): DE++; tick(); NEXT;
         
         // INC HL
-        case 0x23: HL++; tick(); break;
+        OP(0x23): HL++; tick(); NEXT;
 
         // INC SP
-        case 0x33: SP++; tick(); break;
+        OP(0x33): SP++; tick(); NEXT;
 
         // DEC BC
-        case 0x0B: BC--; tick(); break;
+        OP(0x0B): BC--; tick(); NEXT;
 
         // DEC DE
-        case 0x1B: DE--; tick(); break;
+        OP(0x1B): DE--; tick(); NEXT;
 
         // DEC HL
-        case 0x2B: HL--; tick(); break;
+        OP(0x2B): HL--; tick(); NEXT;
 
         // DEC SP
-        case 0x3B: SP--; tick(); break;
+        OP(0x3B): SP--; tick(); NEXT;
 
         // Rotate Shift Instructions
         // RLCA
-        case 0x07: RLCA(); break;
+        OP(0x07): RLCA(); NEXT;
 
         // RLA
-        case 0x17: RLA(); break;
+        OP(0x17): RLA(); NEXT;
 
         // RRCA
-        case 0x0F: RRCA(); break;
+        OP(0x0F): RRCA(); NEXT;
 
         // RRA
-        case 0x1F: RRA(); break;
+        OP(0x1F): RRA(); NEXT;
 
         // CB Prefix
-        case 0xCB:
+        OP(0xCB):
             opcode = readByte();
+#ifdef THREADED
+            goto *CB_OPS[opcode];
+#endif
             switch (opcode) {
                 // Rotate Shift Instructions
                 // RLC
-                case 0x00: B = RLC(B); break;
-                case 0x01: C = RLC(C); break;
-                case 0x02: D = RLC(D); break;
-                case 0x03: E = RLC(E); break;
-                case 0x04: H = RLC(H); break;
-                case 0x05: L = RLC(L); break;
-                case 0x06: write(HL, RLC(read(HL))); break;
-                case 0x07: A = RLC(A); break;
+                CB(0x00): B = RLC(B); NEXT;
+                CB(0x01): C = RLC(C); NEXT;
+                CB(0x02): D = RLC(D); NEXT;
+                CB(0x03): E = RLC(E); NEXT;
+                CB(0x04): H = RLC(H); NEXT;
+                CB(0x05): L = RLC(L); NEXT;
+                CB(0x06): write(HL, RLC(read(HL))); NEXT;
+                CB(0x07): A = RLC(A); NEXT;
 
                 // RL
-                case 0x10: B = RL(B); break;
-                case 0x11: C = RL(C); break;
-                case 0x12: D = RL(D); break;
-                case 0x13: E = RL(E); break;
-                case 0x14: H = RL(H); break;
-                case 0x15: L = RL(L); break;
-                case 0x16: write(HL, RL(read(HL))); break;
-                case 0x17: A = RL(A); break;
+                CB(0x10): B = RL(B); NEXT;
+                CB(0x11): C = RL(C); NEXT;
+                CB(0x12): D = RL(D); NEXT;
+                CB(0x13): E = RL(E); NEXT;
+                CB(0x14): H = RL(H); NEXT;
+                CB(0x15): L = RL(L); NEXT;
+                CB(0x16): write(HL, RL(read(HL))); NEXT;
+                CB(0x17): A = RL(A); NEXT;
 
                 // RRC
-                case 0x08: B = RRC(B); break;
-                case 0x09: C = RRC(C); break;
-                case 0x0A: D = RRC(D); break;
-                case 0x0B: E = RRC(E); break;
-                case 0x0C: H = RRC(H); break;
-                case 0x0D: L = RRC(L); break;
-                case 0x0E: write(HL, RRC(read(HL))); break;
-                case 0x0F: A = RRC(A); break;
+                CB(0x08): B = RRC(B); NEXT;
+                CB(0x09): C = RRC(C); NEXT;
+                CB(0x0A): D = RRC(D); NEXT;
+                CB(0x0B): E = RRC(E); NEXT;
+                CB(0x0C): H = RRC(H); NEXT;
+                CB(0x0D): L = RRC(L); NEXT;
+                CB(0x0E): write(HL, RRC(read(HL))); NEXT;
+                CB(0x0F): A = RRC(A); NEXT;
 
                 // RR
-                case 0x18: B = RR(B); break;
-                case 0x19: C = RR(C); break;
-                case 0x1A: D = RR(D); break;
-                case 0x1B: E = RR(E); break;
-                case 0x1C: H = RR(H); break;
-                case 0x1D: L = RR(L); break;
-                case 0x1E: write(HL, RR(read(HL))); break;
-                case 0x1F: A = RR(A); break;
+                CB(0x18): B = RR(B); NEXT;
+                CB(0x19): C = RR(C); NEXT;
+                CB(0x1A): D = RR(D); NEXT;
+                CB(0x1B): E = RR(E); NEXT;
+                CB(0x1C): H = RR(H); NEXT;
+                CB(0x1D): L = RR(L); NEXT;
+                CB(0x1E): write(HL, RR(read(HL))); NEXT;
+                CB(0x1F): A = RR(A); NEXT;
 
                 // SLA
-                case 0x20: B = SLA(B); break;
-                case 0x21: C = SLA(C); break;
-                case 0x22: D = SLA(D); break;
-                case 0x23: E = SLA(E); break;
-                case 0x24: H = SLA(H); break;
-                case 0x25: L = SLA(L); break;
-                case 0x26: write(HL, SLA(read(HL))); break;
-                case 0x27: A = SLA(A); break;
+                CB(0x20): B = SLA(B); NEXT;
+                CB(0x21): C = SLA(C); NEXT;
+                CB(0x22): D = SLA(D); NEXT;
+                CB(0x23): E = SLA(E); NEXT;
+                CB(0x24): H = SLA(H); NEXT;
+                CB(0x25): L = SLA(L); NEXT;
+                CB(0x26): write(HL, SLA(read(HL))); NEXT;
+                CB(0x27): A = SLA(A); NEXT;
 
                 // SRA
-                case 0x28: B = SRA(B); break;
-                case 0x29: C = SRA(C); break;
-                case 0x2A: D = SRA(D); break;
-                case 0x2B: E = SRA(E); break;
-                case 0x2C: H = SRA(H); break;
-                case 0x2D: L = SRA(L); break;
-                case 0x2E: write(HL, SRA(read(HL))); break;
-                case 0x2F: A = SRA(A); break;
+                CB(0x28): B = SRA(B); NEXT;
+                CB(0x29): C = SRA(C); NEXT;
+                CB(0x2A): D = SRA(D); NEXT;
+                CB(0x2B): E = SRA(E); NEXT;
+                CB(0x2C): H = SRA(H); NEXT;
+                CB(0x2D): L = SRA(L); NEXT;
+                CB(0x2E): write(HL, SRA(read(HL))); NEXT;
+                CB(0x2F): A = SRA(A); NEXT;
 
                 // SRL
-                case 0x38: B = SRL(B); break;
-                case 0x39: C = SRL(C); break;
-                case 0x3A: D = SRL(D); break;
-                case 0x3B: E = SRL(E); break;
-                case 0x3C: H = SRL(H); break;
-                case 0x3D: L = SRL(L); break;
-                case 0x3E: write(HL, SRL(read(HL))); break;
-                case 0x3F: A = SRL(A); break;
+                CB(0x38): B = SRL(B); NEXT;
+                CB(0x39): C = SRL(C); NEXT;
+                CB(0x3A): D = SRL(D); NEXT;
+                CB(0x3B): E = SRL(E); NEXT;
+                CB(0x3C): H = SRL(H); NEXT;
+                CB(0x3D): L = SRL(L); NEXT;
+                CB(0x3E): write(HL, SRL(read(HL))); NEXT;
+                CB(0x3F): A = SRL(A); NEXT;
 
                 // SWAP
-                case 0x30: B = SWAP(B); break;
-                case 0x31: C = SWAP(C); break;
-                case 0x32: D = SWAP(D); break;
-                case 0x33: E = SWAP(E); break;
-                case 0x34: H = SWAP(H); break;
-                case 0x35: L = SWAP(L); break;
-                case 0x36: write(HL, SWAP(read(HL))); break;
-                case 0x37: A = SWAP(A); break;
+                CB(0x30): B = SWAP(B); NEXT;
+                CB(0x31): C = SWAP(C); NEXT;
+                CB(0x32): D = SWAP(D); NEXT;
+                CB(0x33): E = SWAP(E); NEXT;
+                CB(0x34): H = SWAP(H); NEXT;
+                CB(0x35): L = SWAP(L); NEXT;
+                CB(0x36): write(HL, SWAP(read(HL))); NEXT;
+                CB(0x37): A = SWAP(A); NEXT;
 
                 // Bit Operations
                 // BIT 0,r
-                case 0x40: BIT(B, 0); break;
-                case 0x41: BIT(C, 0); break;
-                case 0x42: BIT(D, 0); break;
-                case 0x43: BIT(E, 0); break;
-                case 0x44: BIT(H, 0); break;
-                case 0x45: BIT(L, 0); break;
-                case 0x46: BIT(read(HL), 0); break;
-                case 0x47: BIT(A, 0); break;
+                CB(0x40): BIT(B, 0); NEXT;
+                CB(0x41): BIT(C, 0); NEXT;
+                CB(0x42): BIT(D, 0); NEXT;
+                CB(0x43): BIT(E, 0); NEXT;
+                CB(0x44): BIT(H, 0); NEXT;
+                CB(0x45): BIT(L, 0); NEXT;
+                CB(0x46): BIT(read(HL), 0); NEXT;
+                CB(0x47): BIT(A, 0); NEXT;
 
                 // BIT 1,r
-                case 0x48: BIT(B, 1); break;
-                case 0x49: BIT(C, 1); break;
-                case 0x4A: BIT(D, 1); break;
-                case 0x4B: BIT(E, 1); break;
-                case 0x4C: BIT(H, 1); break;
-                case 0x4D: BIT(L, 1); break;
-                case 0x4E: BIT(read(HL), 1); break;
-                case 0x4F: BIT(A, 1); break;
+                CB(0x48): BIT(B, 1); NEXT;
+                CB(0x49): BIT(C, 1); NEXT;
+                CB(0x4A): BIT(D, 1); NEXT;
+                CB(0x4B): BIT(E, 1); NEXT;
+                CB(0x4C): BIT(H, 1); NEXT;
+                CB(0x4D): BIT(L, 1); NEXT;
+                CB(0x4E): BIT(read(HL), 1); NEXT;
+                CB(0x4F): BIT(A, 1); NEXT;
 
                 // BIT 2,r
-                case 0x50: BIT(B, 2); break;
-                case 0x51: BIT(C, 2); break;
-                case 0x52: BIT(D, 2); break;
-                case 0x53: BIT(E, 2); break;
-                case 0x54: BIT(H, 2); break;
-                case 0x55: BIT(L, 2); break;
-                case 0x56: BIT(read(HL), 2); break;
-                case 0x57: BIT(A, 2); break;
+                CB(0x50): BIT(B, 2); NEXT;
+                CB(0x51): BIT(C, 2); NEXT;
+                CB(0x52): BIT(D, 2); NEXT;
+                CB(0x53): BIT(E, 2); NEXT;
+                CB(0x54): BIT(H, 2); NEXT;
+                CB(0x55): BIT(L, 2); NEXT;
+                CB(0x56): BIT(read(HL), 2); NEXT;
+                CB(0x57): BIT(A, 2); NEXT;
 
                 // BIT 3,r
-                case 0x58: BIT(B, 3); break;
-                case 0x59: BIT(C, 3); break;
-                case 0x5A: BIT(D, 3); break;
-                case 0x5B: BIT(E, 3); break;
-                case 0x5C: BIT(H, 3); break;
-                case 0x5D: BIT(L, 3); break;
-                case 0x5E: BIT(read(HL), 3); break;
-                case 0x5F: BIT(A, 3); break;
+                CB(0x58): BIT(B, 3); NEXT;
+                CB(0x59): BIT(C, 3); NEXT;
+                CB(0x5A): BIT(D, 3); NEXT;
+                CB(0x5B): BIT(E, 3); NEXT;
+                CB(0x5C): BIT(H, 3); NEXT;
+                CB(0x5D): BIT(L, 3); NEXT;
+                CB(0x5E): BIT(read(HL), 3); NEXT;
+                CB(0x5F): BIT(A, 3); NEXT;
 
                 // BIT 4,r
-                case 0x60: BIT(B, 4); break;
-                case 0x61: BIT(C, 4); break;
-                case 0x62: BIT(D, 4); break;
-                case 0x63: BIT(E, 4); break;
-                case 0x64: BIT(H, 4); break;
-                case 0x65: BIT(L, 4); break;
-                case 0x66: BIT(read(HL), 4); break;
-                case 0x67: BIT(A, 4); break;
+                CB(0x60): BIT(B, 4); NEXT;
+                CB(0x61): BIT(C, 4); NEXT;
+                CB(0x62): BIT(D, 4); NEXT;
+                CB(0x63): BIT(E, 4); NEXT;
+                CB(0x64): BIT(H, 4); NEXT;
+                CB(0x65): BIT(L, 4); NEXT;
+                CB(0x66): BIT(read(HL), 4); NEXT;
+                CB(0x67): BIT(A, 4); NEXT;
 
                 // BIT 5,r
-                case 0x68: BIT(B, 5); break;
-                case 0x69: BIT(C, 5); break;
-                case 0x6A: BIT(D, 5); break;
-                case 0x6B: BIT(E, 5); break;
-                case 0x6C: BIT(H, 5); break;
-                case 0x6D: BIT(L, 5); break;
-                case 0x6E: BIT(read(HL), 5); break;
-                case 0x6F: BIT(A, 5); break;
+                CB(0x68): BIT(B, 5); NEXT;
+                CB(0x69): BIT(C, 5); NEXT;
+                CB(0x6A): BIT(D, 5); NEXT;
+                CB(0x6B): BIT(E, 5); NEXT;
+                CB(0x6C): BIT(H, 5); NEXT;
+                CB(0x6D): BIT(L, 5); NEXT;
+                CB(0x6E): BIT(read(HL), 5); NEXT;
+                CB(0x6F): BIT(A, 5); NEXT;
 
                 // BIT 6,r
-                case 0x70: BIT(B, 6); break;
-                case 0x71: BIT(C, 6); break;
-                case 0x72: BIT(D, 6); break;
-                case 0x73: BIT(E, 6); break;
-                case 0x74: BIT(H, 6); break;
-                case 0x75: BIT(L, 6); break;
-                case 0x76: BIT(read(HL), 6); break;
-                case 0x77: BIT(A, 6); break;
+                CB(0x70): BIT(B, 6); NEXT;
+                CB(0x71): BIT(C, 6); NEXT;
+                CB(0x72): BIT(D, 6); NEXT;
+                CB(0x73): BIT(E, 6); NEXT;
+                CB(0x74): BIT(H, 6); NEXT;
+                CB(0x75): BIT(L, 6); NEXT;
+                CB(0x76): BIT(read(HL), 6); NEXT;
+                CB(0x77): BIT(A, 6); NEXT;
 
                 // BIT 7,r
-                case 0x78: BIT(B, 7); break;
-                case 0x79: BIT(C, 7); break;
-                case 0x7A: BIT(D, 7); break;
-                case 0x7B: BIT(E, 7); break;
-                case 0x7C: BIT(H, 7); break;
-                case 0x7D: BIT(L, 7); break;
-                case 0x7E: BIT(read(HL), 7); break;
-                case 0x7F: BIT(A, 7); break;
+                CB(0x78): BIT(B, 7); NEXT;
+                CB(0x79): BIT(C, 7); NEXT;
+                CB(0x7A): BIT(D, 7); NEXT;
+                CB(0x7B): BIT(E, 7); NEXT;
+                CB(0x7C): BIT(H, 7); NEXT;
+                CB(0x7D): BIT(L, 7); NEXT;
+                CB(0x7E): BIT(read(HL), 7); NEXT;
+                CB(0x7F): BIT(A, 7); NEXT;
 
                 // RES 0,r
-                case 0x80: B = RES(B, 0); break;
-                case 0x81: C = RES(C, 0); break;
-                case 0x82: D = RES(D, 0); break;
-                case 0x83: E = RES(E, 0); break;
-                case 0x84: H = RES(H, 0); break;
-                case 0x85: L = RES(L, 0); break;
-                case 0x86: write(HL, RES(read(HL), 0)); break;
-                case 0x87: A = RES(A, 0); break;
+                CB(0x80): B = RES(B, 0); NEXT;
+                CB(0x81): C = RES(C, 0); NEXT;
+                CB(0x82): D = RES(D, 0); NEXT;
+                CB(0x83): E = RES(E, 0); NEXT;
+                CB(0x84): H = RES(H, 0); NEXT;
+                CB(0x85): L = RES(L, 0); NEXT;
+                CB(0x86): write(HL, RES(read(HL), 0)); NEXT;
+                CB(0x87): A = RES(A, 0); NEXT;
 
                 // RES 1,r
-                case 0x88: B = RES(B, 1); break;
-                case 0x89: C = RES(C, 1); break;
-                case 0x8A: D = RES(D, 1); break;
-                case 0x8B: E = RES(E, 1); break;
-                case 0x8C: H = RES(H, 1); break;
-                case 0x8D: L = RES(L, 1); break;
-                case 0x8E: write(HL, RES(read(HL), 1)); break;
-                case 0x8F: A = RES(A, 1); break;
+                CB(0x88): B = RES(B, 1); NEXT;
+                CB(0x89): C = RES(C, 1); NEXT;
+                CB(0x8A): D = RES(D, 1); NEXT;
+                CB(0x8B): E = RES(E, 1); NEXT;
+                CB(0x8C): H = RES(H, 1); NEXT;
+                CB(0x8D): L = RES(L, 1); NEXT;
+                CB(0x8E): write(HL, RES(read(HL), 1)); NEXT;
+                CB(0x8F): A = RES(A, 1); NEXT;
 
                 // RES 2,r
-                case 0x90: B = RES(B, 2); break;
-                case 0x91: C = RES(C, 2); break;
-                case 0x92: D = RES(D, 2); break;
-                case 0x93: E = RES(E, 2); break;
-                case 0x94: H = RES(H, 2); break;
-                case 0x95: L = RES(L, 2); break;
-                case 0x96: write(HL, RES(read(HL), 2)); break;
-                case 0x97: A = RES(A, 2); break;
+                CB(0x90): B = RES(B, 2); NEXT;
+                CB(0x91): C = RES(C, 2); NEXT;
+                CB(0x92): D = RES(D, 2); NEXT;
+                CB(0x93): E = RES(E, 2); NEXT;
+                CB(0x94): H = RES(H, 2); NEXT;
+                CB(0x95): L = RES(L, 2); NEXT;
+                CB(0x96): write(HL, RES(read(HL), 2)); NEXT;
+                CB(0x97): A = RES(A, 2); NEXT;
 
                 // RES 3,r
-                case 0x98: B = RES(B, 3); break;
-                case 0x99: C = RES(C, 3); break;
-                case 0x9A: D = RES(D, 3); break;
-                case 0x9B: E = RES(E, 3); break;
-                case 0x9C: H = RES(H, 3); break;
-                case 0x9D: L = RES(L, 3); break;
-                case 0x9E: write(HL, RES(read(HL), 3)); break;
-                case 0x9F: A = RES(A, 3); break;
+                CB(0x98): B = RES(B, 3); NEXT;
+                CB(0x99): C = RES(C, 3); NEXT;
+                CB(0x9A): D = RES(D, 3); NEXT;
+                CB(0x9B): E = RES(E, 3); NEXT;
+                CB(0x9C): H = RES(H, 3); NEXT;
+                CB(0x9D): L = RES(L, 3); NEXT;
+                CB(0x9E): write(HL, RES(read(HL), 3)); NEXT;
+                CB(0x9F): A = RES(A, 3); NEXT;
 
                 // RES 4,r
-                case 0xA0: B = RES(B, 4); break;
-                case 0xA1: C = RES(C, 4); break;
-                case 0xA2: D = RES(D, 4); break;
-                case 0xA3: E = RES(E, 4); break;
-                case 0xA4: H = RES(H, 4); break;
-                case 0xA5: L = RES(L, 4); break;
-                case 0xA6: write(HL, RES(read(HL), 4)); break;
-                case 0xA7: A = RES(A, 4); break;
+                CB(0xA0): B = RES(B, 4); NEXT;
+                CB(0xA1): C = RES(C, 4); NEXT;
+                CB(0xA2): D = RES(D, 4); NEXT;
+                CB(0xA3): E = RES(E, 4); NEXT;
+                CB(0xA4): H = RES(H, 4); NEXT;
+                CB(0xA5): L = RES(L, 4); NEXT;
+                CB(0xA6): write(HL, RES(read(HL), 4)); NEXT;
+                CB(0xA7): A = RES(A, 4); NEXT;
 
                 // RES 5,r
-                case 0xA8: B = RES(B, 5); break;
-                case 0xA9: C = RES(C, 5); break;
-                case 0xAA: D = RES(D, 5); break;
-                case 0xAB: E = RES(E, 5); break;
-                case 0xAC: H = RES(H, 5); break;
-                case 0xAD: L = RES(L, 5); break;
-                case 0xAE: write(HL, RES(read(HL), 5)); break;
-                case 0xAF: A = RES(A, 5); break;
+                CB(0xA8): B = RES(B, 5); NEXT;
+                CB(0xA9): C = RES(C, 5); NEXT;
+                CB(0xAA): D = RES(D, 5); NEXT;
+                CB(0xAB): E = RES(E, 5); NEXT;
+                CB(0xAC): H = RES(H, 5); NEXT;
+                CB(0xAD): L = RES(L, 5); NEXT;
+                CB(0xAE): write(HL, RES(read(HL), 5)); NEXT;
+                CB(0xAF): A = RES(A, 5); NEXT;
 
                 // RES 6,r
-                case 0xB0: B = RES(B, 6); break;
-                case 0xB1: C = RES(C, 6); break;
-                case 0xB2: D = RES(D, 6); break;
-                case 0xB3: E = RES(E, 6); break;
-                case 0xB4: H = RES(H, 6); break;
-                case 0xB5: L = RES(L, 6); break;
-                case 0xB6: write(HL, RES(read(HL), 6)); break;
-                case 0xB7: A = RES(A, 6); break;
+                CB(0xB0): B = RES(B, 6); NEXT;
+                CB(0xB1): C = RES(C, 6); NEXT;
+                CB(0xB2): D = RES(D, 6); NEXT;
+                CB(0xB3): E = RES(E, 6); NEXT;
+                CB(0xB4): H = RES(H, 6); NEXT;
+                CB(0xB5): L = RES(L, 6); NEXT;
+                CB(0xB6): write(HL, RES(read(HL), 6)); NEXT;
+                CB(0xB7): A = RES(A, 6); NEXT;
 
                 // RES 7,r
-                case 0xB8: B = RES(B, 7); break;
-                case 0xB9: C = RES(C, 7); break;
-                case 0xBA: D = RES(D, 7); break;
-                case 0xBB: E = RES(E, 7); break;
-                case 0xBC: H = RES(H, 7); break;
-                case 0xBD: L = RES(L, 7); break;
-                case 0xBE: write(HL, RES(read(HL), 7)); break;
-                case 0xBF: A = RES(A, 7); break;
+                CB(0xB8): B = RES(B, 7); NEXT;
+                CB(0xB9): C = RES(C, 7); NEXT;
+                CB(0xBA): D = RES(D, 7); NEXT;
+                CB(0xBB): E = RES(E, 7); NEXT;
+                CB(0xBC): H = RES(H, 7); NEXT;
+                CB(0xBD): L = RES(L, 7); NEXT;
+                CB(0xBE): write(HL, RES(read(HL), 7)); NEXT;
+                CB(0xBF): A = RES(A, 7); NEXT;
 
                 // SET 0,r
-                case 0xC0: B = SET(B, 0); break;
-                case 0xC1: C = SET(C, 0); break;
-                case 0xC2: D = SET(D, 0); break;
-                case 0xC3: E = SET(E, 0); break;
-                case 0xC4: H = SET(H, 0); break;
-                case 0xC5: L = SET(L, 0); break;
-                case 0xC6: write(HL, SET(read(HL), 0)); break;
-                case 0xC7: A = SET(A, 0); break;
+                CB(0xC0): B = SET(B, 0); NEXT;
+                CB(0xC1): C = SET(C, 0); NEXT;
+                CB(0xC2): D = SET(D, 0); NEXT;
+                CB(0xC3): E = SET(E, 0); NEXT;
+                CB(0xC4): H = SET(H, 0); NEXT;
+                CB(0xC5): L = SET(L, 0); NEXT;
+                CB(0xC6): write(HL, SET(read(HL), 0)); NEXT;
+                CB(0xC7): A = SET(A, 0); NEXT;
 
                 // SET 1,r
-                case 0xC8: B = SET(B, 1); break;
-                case 0xC9: C = SET(C, 1); break;
-                case 0xCA: D = SET(D, 1); break;
-                case 0xCB: E = SET(E, 1); break;
-                case 0xCC: H = SET(H, 1); break;
-                case 0xCD: L = SET(L, 1); break;
-                case 0xCE: write(HL, SET(read(HL), 1)); break;
-                case 0xCF: A = SET(A, 1); break;
+                CB(0xC8): B = SET(B, 1); NEXT;
+                CB(0xC9): C = SET(C, 1); NEXT;
+                CB(0xCA): D = SET(D, 1); NEXT;
+                CB(0xCB): E = SET(E, 1); NEXT;
+                CB(0xCC): H = SET(H, 1); NEXT;
+                CB(0xCD): L = SET(L, 1); NEXT;
+                CB(0xCE): write(HL, SET(read(HL), 1)); NEXT;
+                CB(0xCF): A = SET(A, 1); NEXT;
 
                 // SET 2,r
-                case 0xD0: B = SET(B, 2); break;
-                case 0xD1: C = SET(C, 2); break;
-                case 0xD2: D = SET(D, 2); break;
-                case 0xD3: E = SET(E, 2); break;
-                case 0xD4: H = SET(H, 2); break;
-                case 0xD5: L = SET(L, 2); break;
-                case 0xD6: write(HL, SET(read(HL), 2)); break;
-                case 0xD7: A = SET(A, 2); break;
+                CB(0xD0): B = SET(B, 2); NEXT;
+                CB(0xD1): C = SET(C, 2); NEXT;
+                CB(0xD2): D = SET(D, 2); NEXT;
+                CB(0xD3): E = SET(E, 2); NEXT;
+                CB(0xD4): H = SET(H, 2); NEXT;
+                CB(0xD5): L = SET(L, 2); NEXT;
+                CB(0xD6): write(HL, SET(read(HL), 2)); NEXT;
+                CB(0xD7): A = SET(A, 2); NEXT;
 
                 // SET 3,r
-                case 0xD8: B = SET(B, 3); break;
-                case 0xD9: C = SET(C, 3); break;
-                case 0xDA: D = SET(D, 3); break;
-                case 0xDB: E = SET(E, 3); break;
-                case 0xDC: H = SET(H, 3); break;
-                case 0xDD: L = SET(L, 3); break;
-                case 0xDE: write(HL, SET(read(HL), 3)); break;
-                case 0xDF: A = SET(A, 3); break;
+                CB(0xD8): B = SET(B, 3); NEXT;
+                CB(0xD9): C = SET(C, 3); NEXT;
+                CB(0xDA): D = SET(D, 3); NEXT;
+                CB(0xDB): E = SET(E, 3); NEXT;
+                CB(0xDC): H = SET(H, 3); NEXT;
+                CB(0xDD): L = SET(L, 3); NEXT;
+                CB(0xDE): write(HL, SET(read(HL), 3)); NEXT;
+                CB(0xDF): A = SET(A, 3); NEXT;
 
                 // SET 4,r
-                case 0xE0: B = SET(B, 4); break;
-                case 0xE1: C = SET(C, 4); break;
-                case 0xE2: D = SET(D, 4); break;
-                case 0xE3: E = SET(E, 4); break;
-                case 0xE4: H = SET(H, 4); break;
-                case 0xE5: L = SET(L, 4); break;
-                case 0xE6: write(HL, SET(read(HL), 4)); break;
-                case 0xE7: A = SET(A, 4); break;
+                CB(0xE0): B = SET(B, 4); NEXT;
+                CB(0xE1): C = SET(C, 4); NEXT;
+                CB(0xE2): D = SET(D, 4); NEXT;
+                CB(0xE3): E = SET(E, 4); NEXT;
+                CB(0xE4): H = SET(H, 4); NEXT;
+                CB(0xE5): L = SET(L, 4); NEXT;
+                CB(0xE6): write(HL, SET(read(HL), 4)); NEXT;
+                CB(0xE7): A = SET(A, 4); NEXT;
 
                 // SET 5,r
-                case 0xE8: B = SET(B, 5); break;
-                case 0xE9: C = SET(C, 5); break;
-                case 0xEA: D = SET(D, 5); break;
-                case 0xEB: E = SET(E, 5); break;
-                case 0xEC: H = SET(H, 5); break;
-                case 0xED: L = SET(L, 5); break;
-                case 0xEE: write(HL, SET(read(HL), 5)); break;
-                case 0xEF: A = SET(A, 5); break;
+                CB(0xE8): B = SET(B, 5); NEXT;
+                CB(0xE9): C = SET(C, 5); NEXT;
+                CB(0xEA): D = SET(D, 5); NEXT;
+                CB(0xEB): E = SET(E, 5); NEXT;
+                CB(0xEC): H = SET(H, 5); NEXT;
+                CB(0xED): L = SET(L, 5); NEXT;
+                CB(0xEE): write(HL, SET(read(HL), 5)); NEXT;
+                CB(0xEF): A = SET(A, 5); NEXT;
 
                 // SET 6,r
-                case 0xF0: B = SET(B, 6); break;
-                case 0xF1: C = SET(C, 6); break;
-                case 0xF2: D = SET(D, 6); break;
-                case 0xF3: E = SET(E, 6); break;
-                case 0xF4: H = SET(H, 6); break;
-                case 0xF5: L = SET(L, 6); break;
-                case 0xF6: write(HL, SET(read(HL), 6)); break;
-                case 0xF7: A = SET(A, 6); break;
+                CB(0xF0): B = SET(B, 6); NEXT;
+                CB(0xF1): C = SET(C, 6); NEXT;
+                CB(0xF2): D = SET(D, 6); NEXT;
+                CB(0xF3): E = SET(E, 6); NEXT;
+                CB(0xF4): H = SET(H, 6); NEXT;
+                CB(0xF5): L = SET(L, 6); NEXT;
+                CB(0xF6): write(HL, SET(read(HL), 6)); NEXT;
+                CB(0xF7): A = SET(A, 6); NEXT;
 
                 // SET 7,r
-                case 0xF8: B = SET(B, 7); break;
-                case 0xF9: C = SET(C, 7); break;
-                case 0xFA: D = SET(D, 7); break;
-                case 0xFB: E = SET(E, 7); break;
-                case 0xFC: H = SET(H, 7); break;
-                case 0xFD: L = SET(L, 7); break;
-                case 0xFE: write(HL, SET(read(HL), 7)); break;
-                case 0xFF: A = SET(A, 7); break;
-
-                default: break;
+                CB(0xF8): B = SET(B, 7); NEXT;
+                CB(0xF9): C = SET(C, 7); NEXT;
+                CB(0xFA): D = SET(D, 7); NEXT;
+                CB(0xFB): E = SET(E, 7); NEXT;
+                CB(0xFC): H = SET(H, 7); NEXT;
+                CB(0xFD): L = SET(L, 7); NEXT;
+                CB(0xFE): write(HL, SET(read(HL), 7)); NEXT;
+                CB(0xFF): A = SET(A, 7); NEXT;
+
+                default: NEXT;
             }
-            break;
+            NEXT;
 
         // Jump Instructions
         // JP nn
-        case 0xC3: JP(true); break;
+        OP(0xC3): JP(true); NEXT;
 
         // JP NZ,nn
-        case 0xC2: JP(!ZERO_F()); break;
+        OP(0xC2): JP(!ZERO_F()); NEXT;
 
         // JP Z,nn
-        case 0xCA: JP(ZERO_F()); break;
+        OP(0xCA): JP(ZERO_F()); NEXT;
 
         // JP NC,nn
-        case 0xD2: JP(!CARRY_F()); break;
+        OP(0xD2): JP(!CARRY_F()); NEXT;
 
         // JP C,nn
-        case 0xDA: JP(CARRY_F()); break;
+        OP(0xDA): JP(CARRY_F()); NEXT;
 
         // JR e
-        case 0x18: JR(true); break;
+        OP(0x18): JR(true); NEXT;
 
         // JR NZ,e
-        case 0x20: JR(!ZERO_F()); break;
+        OP(0x20): JR(!ZERO_F()); NEXT;
 
         // JR Z,e
-        case 0x28: JR(ZERO_F()); break;
+        OP(0x28): JR(ZERO_F()); NEXT;
 
         // JR NC,e
-        case 0x30: JR(!CARRY_F()); break;
+        OP(0x30): JR(!CARRY_F()); NEXT;
 
         // JR C,e
-        case 0x38: JR(CARRY_F()); break;
+        OP(0x38): JR(CARRY_F()); NEXT;
 
         // JP HL
-        case 0xE9: PC = HL; break;
+        OP(0xE9): PC = HL; NEXT;
 
         // Call and Return Instructions
         // CALL nn
-        case 0xCD: CALL(true); break;
+        OP(0xCD): CALL(true); NEXT;
 
         // CALL NZ,nn
-        case 0xC4: CALL(!ZERO_F()); break;
+        OP(0xC4): CALL(!ZERO_F()); NEXT;
 
         // CALL Z,nn
-        case 0xCC: CALL(ZERO_F()); break;
+        OP(0xCC): CALL(ZERO_F()); NEXT;
 
         // CALL NC,nn
-        case 0xD4: CALL(!CARRY_F()); break;
+        OP(0xD4): CALL(!CARRY_F()); NEXT;
 
         // CALL C,nn
-        case 0xDC: CALL(CARRY_F()); break;
+        OP(0xDC): CALL(CARRY_F()); NEXT;
 
         // RET
-        case 0xC9: PC = pop(); tick(); break;
+        OP(0xC9): PC = pop(); tick(); NEXT;
 
         // RETI
-        case 0xD9: PC = pop(); IME = 1; tick(); break;
+        OP(0xD9): PC = pop(); IME = 1; memory.interruptsChanged = true; tick(); NEXT;
 
         // RET NZ
-        case 0xC0: RET(!ZERO_F()); break;
+        OP(0xC0): RET(!ZERO_F()); NEXT;
 
         // RET Z
-        case 0xC8: RET(ZERO_F()); break;
+        OP(0xC8): RET(ZERO_F()); NEXT;
 
         // RET NC
-        case 0xD0: RET(!CARRY_F()); break;
+        OP(0xD0): RET(!CARRY_F()); NEXT;
 
         // RET C
-        case 0xD8: RET(CARRY_F()); break;
+        OP(0xD8): RET(CARRY_F()); NEXT;
 
         // RST
-        case 0xC7: push(PC); PC = 0x00; break;
-        case 0xCF: push(PC); PC = 0x08; break;
-        case 0xD7: push(PC); PC = 0x10; break;
-        case 0xDF: push(PC); PC = 0x18; break;
-        case 0xE7: push(PC); PC = 0x20; break;
-        case 0xEF: push(PC); PC = 0x28; break;
-        case 0xF7: push(PC); PC = 0x30; break;
-        case 0xFF: push(PC); PC = 0x38; break;
+        OP(0xC7): push(PC); PC = 0x00; NEXT;
+        OP(0xCF): push(PC); PC = 0x08; NEXT;
+        OP(0xD7): push(PC); PC = 0x10; NEXT;
+        OP(0xDF): push(PC); PC = 0x18; NEXT;
+        OP(0xE7): push(PC); PC = 0x20; NEXT;
+        OP(0xEF): push(PC); PC = 0x28; NEXT;
+        OP(0xF7): push(PC); PC = 0x30; NEXT;
+        OP(0xFF): push(PC); PC = 0x38; NEXT;
 
         // General-Purpose Arithmetic Operations and CPU Control Instructions
         // DAA
-        case 0x27:
+        OP(0x27):
+#ifdef ALU_TABLES
+            AF = alu.daa[(F >> 4) & 0x7][A];
+#else
             n = 0;
             if (HALF_F() || (!SUB_F() && ((A & 0xF) > 0x09))) {
                 n |= 0x06;
@@ -1222,38 +1614,49 @@ void CPU::cycle() {
             }
             A += (SUB_F() ? -n : n);
             F = ZERO_S(A) | SUB_F() | (n > 0x06 ? CARRY : 0);
-            break;
+#endif
+            NEXT;
 
         // CPL
-        case 0x2F: A = ~A; F = ZERO_F() | NEG | HALF | CARRY_F(); break;
+        OP(0x2F): A = ~A; F = ZERO_F() | NEG | HALF | CARRY_F(); NEXT;
 
         // NOP
-        case 0x00: break;
+        OP(0x00): NEXT;
 
         // CCF
-        case 0x3F: F = ZERO_F() | (CARRY_F() ^ (1 << 4)); break;
+        OP(0x3F): F = ZERO_F() | (CARRY_F() ^ (1 << 4)); NEXT;
 
         // SCF
-        case 0x37: F = ZERO_F() | CARRY; break;
+        OP(0x37): F = ZERO_F() | CARRY; NEXT;
 
         // DI
-        case 0xF3: IRQ = 0; IME = 0; break;
+        OP(0xF3): IRQ = 0; IME = 0; NEXT;
 
         // EI
-        case 0xFB: IRQ = 2; break;
+        OP(0xFB): IRQ = 2; NEXT;
 
         // HALT
-        case 0x76:
+        OP(0x76):
             if (IME || interrupt == 0) {
                 halted = 1;
             } else {
                 haltBug = 1;
             }
-            break;
+            NEXT;
 
         // STOP
-        case 0x10: ++PC; break;
+        OP(0x10): ++PC; NEXT;
 
-        default: break;
+        OP_DEFAULT: NEXT;
+    }
+#ifdef THREADED
+next:
+    // The checks cycle() would make before the next instruction
+    if (dispatched || scheduler.cycles >= limit || IRQ != 0 || halted || haltBug
+        || memory.interruptsChanged || memory.joypad.interrupt) {
+        return;
     }
+    fetch();
+    goto start;
+#endif
 }
@@ -2,6 +2,10 @@
 
 #include <cstdint>
 
+#ifdef JIT
+#include "jit.hpp"
+#endif
+
 union RegisterPair {
     struct {
         uint8_t low;
@@ -12,17 +16,32 @@ union RegisterPair {
     };
 };
 
+struct Registers {
+    uint16_t AF, BC, DE, HL, SP, PC;
+};
+
 class Memory;
 class PPU;
+class Scheduler;
+class State;
 
 class CPU {
+    friend class Jit;
+
     public:
         Memory& memory;
         PPU& ppu;
+        Scheduler& scheduler;
         long long totalCycles;
         bool run;
+#ifdef JIT
+        Jit jit;
+#endif
         void init();
-        void cycle();
+        void cycle(uint64_t limit);
+        void syncFlags();
+        Registers registers();
+        void serialize(State& state);
         CPU(Memory& memory, PPU& ppu);
 
     private:
@@ -36,13 +55,35 @@ class CPU {
         uint16_t SP;
         uint16_t PC;
         uint8_t opcode;
+        const uint8_t* operand; // Pre-decoded operand bytes of a cached op
 
         bool halted;
         bool haltBug;
         uint8_t IRQ;
         bool IME;
-
+        uint8_t interrupt;
+
+#ifdef LAZY_FLAGS
+        // The last ADD/SUB-like operation, F is only current when EAGER
+        enum Flags {
+            EAGER,
+            ADDED,
+            SUBTRACTED,
+            INCREMENTED,
+            DECREMENTED
+        };
+        uint8_t flags;
+        uint8_t flagX;  // Operands XORed, bit 4 gives the half carry
+        uint16_t flagR; // Result with the carry in bit 8
+        uint8_t flagC;  // Carry kept by INC/DEC
+#endif
+
+        uint64_t limit;  // Where the threaded core stops chaining, 0 for one instruction
+        bool dispatched; // An event fired during this cycle()
         void tick();
+        void dispatch();
+        void execute();
+        bool interrupts();
 
         uint8_t ZERO_F();
         uint8_t SUB_F();
@@ -71,6 +112,7 @@ class CPU {
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
 
+        void fetch();
         uint8_t readByte();
         uint16_t readb16();
 
@@ -0,0 +1,261 @@
+#include <algorithm>
+
+#include "jit.hpp"
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "scheduler.hpp"
+
+#if defined(JIT) && defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X64
+#endif
+
+// Code goes into chunks mapped on the first compile, so instances that never
+// enable the JIT map nothing. Chunks are never writable and executable at once.
+const size_t CHUNK = 1 << 20;
+const size_t CHUNKS = 16;
+const uint32_t HOT = 16;
+
+// Condition codes for Jcc
+const uint8_t JZ = 0x4;
+const uint8_t JNE = 0x5;
+
+Jit::Jit(CPU& cpu) : cpu(cpu) {
+    enabled = false;
+    used = 0;
+    clears = 0;
+    window = 0;
+    switches = 0;
+}
+
+Jit::~Jit() {
+    release();
+}
+
+bool Jit::available() {
+#ifdef JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::release() {
+#ifdef JIT_X64
+    for (uint8_t* chunk : chunks) {
+        munmap(chunk, CHUNK);
+    }
+#endif
+    chunks.clear();
+    used = 0;
+}
+
+// Room for code.size() bytes, in a new chunk when the last one is full
+uint8_t* Jit::place() {
+#ifdef JIT_X64
+    if (chunks.empty() || used + code.size() > CHUNK) {
+        if (chunks.size() >= CHUNKS || code.size() > CHUNK) {
+            return nullptr;
+        }
+        void* p = mmap(nullptr, CHUNK, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+        chunks.push_back((uint8_t*) p);
+        used = 0;
+    }
+    return chunks.back() + used;
+#else
+    return nullptr;
+#endif
+}
+
+// Runs the block at PC if it is compiled, or hot enough to compile
+bool Jit::run() {
+#ifndef JIT_X64
+    return false;
+#endif
+
+    BlockCache& blocks = cpu.memory.blocks;
+    if (clears != blocks.clears) {
+        // A new ROM, nothing refers to the old code anymore
+        clears = blocks.clears;
+        release();
+    }
+
+    BlockCache::Block* block = blocks.enter(cpu.PC);
+    if (!block) {
+        return false;
+    }
+    if (!block->code) {
+        if (++block->runs < HOT) {
+            return false;
+        }
+        block->code = compile(*block);
+        if (!block->code) {
+            block->runs = 0; // Out of chunks, retry after a while
+            return false;
+        }
+    }
+
+    // The window the code runs in, a bank mapped in both has a block for each
+    window = cpu.PC >> 14;
+    switches = blocks.switches[window];
+    ((void (*)()) block->code)();
+    blocks.reset();
+    return true;
+}
+
+void Jit::dispatch(CPU* cpu) {
+    cpu->dispatch();
+}
+
+// Runs one op through the interpreter, false once the block has to be left
+bool Jit::step(Jit* jit, const BlockCache::Op* op) {
+    CPU& cpu = jit->cpu;
+    cpu.opcode = op->opcode;
+    cpu.operand = op->operand;
+    cpu.PC++;
+    cpu.tick();
+    cpu.limit = 0;
+    cpu.execute();
+    return !(cpu.IRQ || cpu.halted || cpu.memory.interruptsChanged
+        || cpu.memory.blocks.switches[jit->window] != jit->switches);
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+void Jit::emit32(int32_t n) {
+    for (int i = 0; i < 4; ++i) {
+        code.push_back(n >> (i * 8));
+    }
+}
+
+void Jit::emit64(uint64_t n) {
+    for (int i = 0; i < 8; ++i) {
+        code.push_back(n >> (i * 8));
+    }
+}
+
+// Fields are addressed relative to the CPU in rbx, all of them live in the same NicoGB
+int32_t Jit::offset(const void* field) {
+    return (const uint8_t*) field - (const uint8_t*) &cpu;
+}
+
+void Jit::call(const void* function) {
+    emit({0x48, 0xB8}); emit64((uint64_t) function); // mov rax, function
+    emit({0xFF, 0xD0});                              // call rax
+}
+
+// CPU::tick() with the event check inline
+void Jit::tick() {
+    emit({0x48, 0x83, 0x83}); emit32(offset(&cpu.totalCycles)); emit({0x04}); // add qword [totalCycles], 4
+    emit({0x48, 0x8B, 0x83}); emit32(offset(&cpu.scheduler.cycles));          // mov rax, [cycles]
+    emit({0x48, 0x83, 0xC0, 0x04});                                            // add rax, 4
+    emit({0x48, 0x89, 0x83}); emit32(offset(&cpu.scheduler.cycles));          // mov [cycles], rax
+    emit({0x48, 0x3B, 0x83}); emit32(offset(&cpu.scheduler.next));            // cmp rax, [next]
+    emit({0x72, 0x00});                                                        // jb skip
+    size_t skip = code.size();
+    emit({0x48, 0x89, 0xDF});                                                  // mov rdi, rbx
+    call((const void*) &Jit::dispatch);
+    code[skip - 1] = code.size() - skip;
+}
+
+void Jit::exitIf(uint8_t condition, std::vector<size_t>& exits) {
+    emit({0x0F, (uint8_t) (0x80 | condition)}); emit32(0); // jcc exit
+    exits.push_back(code.size());
+}
+
+void* Jit::compile(const BlockCache::Block& block) {
+    uint8_t* regs[8] = {&cpu.B, &cpu.C, &cpu.D, &cpu.E, &cpu.H, &cpu.L, nullptr, &cpu.A};
+    uint16_t* pairs[4] = {&cpu.BC, &cpu.DE, &cpu.HL, &cpu.SP};
+    std::vector<size_t> exits;
+
+    for (const void* field : {(const void*) &cpu.memory.interruptsChanged, (const void*) &cpu.scheduler.next}) {
+        int64_t distance = (const uint8_t*) field - (const uint8_t*) &cpu;
+        if (distance != (int32_t) distance) {
+            return nullptr;
+        }
+    }
+
+    code.clear();
+    emit({0x53});                                            // push rbx
+    emit({0x48, 0xBB}); emit64((uint64_t) &cpu);             // mov rbx, cpu
+
+    for (const auto& op : block.ops) {
+        uint8_t o = op.opcode;
+        uint8_t dst = (o >> 3) & 0x7;
+        uint8_t src = o & 0x7;
+        bool inlined = true;
+
+        if (o == 0x00) {
+            // NOP
+            emit({0x66, 0x83, 0x83}); emit32(offset(&cpu.PC)); emit({0x01}); // add word [PC], 1
+            tick();
+        } else if (o >= 0x40 && o <= 0x7F && o != 0x76 && regs[dst] && regs[src]) {
+            // LD r,r'
+            emit({0x66, 0x83, 0x83}); emit32(offset(&cpu.PC)); emit({0x01});
+            tick();
+            emit({0x8A, 0x83}); emit32(offset(regs[src]));                   // mov al, [src]
+            emit({0x88, 0x83}); emit32(offset(regs[dst]));                   // mov [dst], al
+        } else if (o < 0x40 && src == 0x6 && regs[dst]) {
+            // LD r,n
+            emit({0x66, 0x83, 0x83}); emit32(offset(&cpu.PC)); emit({0x02}); // add word [PC], 2
+            tick();
+            tick();
+            emit({0xC6, 0x83}); emit32(offset(regs[dst])); emit({op.operand[0]}); // mov byte [dst], n
+        } else if (o < 0x40 && (o & 0x7) == 0x3) {
+            // INC rr, DEC rr
+            emit({0x66, 0x83, 0x83}); emit32(offset(&cpu.PC)); emit({0x01});
+            tick();
+            uint8_t modrm = (o & 0x08) ? 0xAB : 0x83;                       // sub or add
+            emit({0x66, 0x83, modrm}); emit32(offset(pairs[o >> 4])); emit({0x01});
+            tick();
+        } else {
+            inlined = false;
+            emit({0x48, 0xBF}); emit64((uint64_t) this);                     // mov rdi, jit
+            emit({0x48, 0xBE}); emit64((uint64_t) &op);                      // mov rsi, op
+            call((const void*) &Jit::step);
+            emit({0x84, 0xC0});                                              // test al, al
+            exitIf(JZ, exits);                                               // jz exit
+        }
+
+        if (inlined) {
+            // Only an event can have raised an interrupt
+            emit({0x80, 0xBB}); emit32(offset(&cpu.memory.interruptsChanged)); emit({0x00}); // cmp byte [changed], 0
+            exitIf(JNE, exits);
+        }
+    }
+
+    for (size_t exit : exits) {
+        int32_t rel = code.size() - exit;
+        for (int i = 0; i < 4; ++i) {
+            code[exit - 4 + i] = rel >> (i * 8);
+        }
+    }
+    emit({0x5B});                                            // pop rbx
+    emit({0xC3});                                            // ret
+
+    uint8_t* start = place();
+    if (!start) {
+        return nullptr;
+    }
+#ifdef JIT_X64
+    // Only the pages the block lands on turn writable, and only while it is copied
+    static const uintptr_t PAGE = sysconf(_SC_PAGESIZE);
+    uint8_t* first = (uint8_t*) ((uintptr_t) start & ~(PAGE - 1));
+    size_t length = start + code.size() - first;
+    if (mprotect(first, length, PROT_READ | PROT_WRITE) != 0) {
+        return nullptr;
+    }
+    std::copy(code.begin(), code.end(), start);
+    used += code.size();
+    if (mprotect(first, length, PROT_READ | PROT_EXEC) != 0) {
+        return nullptr;
+    }
+#endif
+    return start;
+}
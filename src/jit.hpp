@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "blockcache.hpp"
+
+class CPU;
+
+// Translates hot ROM blocks to x86-64. Register moves and the cycle
+// bookkeeping are emitted inline, every other op calls back into the
+// interpreter, so memory accesses still go through the Memory handlers.
+class Jit {
+    public:
+        bool enabled;
+        bool available();
+        bool run();
+        Jit(CPU& cpu);
+        ~Jit();
+
+    private:
+        CPU& cpu;
+        std::vector<uint8_t*> chunks;
+        size_t used; // Bytes taken in the last chunk
+        uint32_t clears;
+        int window;
+        uint32_t switches;
+        std::vector<uint8_t> code;
+
+        void* compile(const BlockCache::Block& block);
+        uint8_t* place();
+        void release();
+        void emit(std::initializer_list<uint8_t> bytes);
+        void emit32(int32_t n);
+        void emit64(uint64_t n);
+        int32_t offset(const void* field);
+        void call(const void* function);
+        void tick();
+        void exitIf(uint8_t condition, std::vector<size_t>& exits);
+
+        static void dispatch(CPU* cpu);
+        static bool step(Jit* jit, const BlockCache::Op* op);
+};
@@ -1,4 +1,5 @@
 #include "joypad.hpp"
+#include "state.hpp"
 
 Joypad::Joypad() {
     reset();
@@ -51,3 +52,10 @@ void Joypad::keyUp(Key key) {
         default: break;
     } 
 }
+
+void Joypad::serialize(State& state) {
+    state.value(keys[0]);
+    state.value(keys[1]);
+    state.value(mode);
+    state.value(interrupt);
+}
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 
+class State;
+
 enum Key {
     RIGHT,
     LEFT,
@@ -26,5 +28,6 @@ class Joypad {
         void write(uint8_t n);
         void keyDown(Key key);
         void keyUp(Key key);
+        void serialize(State& state);
         Joypad();
 };
@@ -0,0 +1,107 @@
+#include <cstring>
+
+#include "lz4.hpp"
+
+const int HASH_BITS = 12;
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5; // The format ends on literals
+const size_t MATCH_LIMIT = 12;  // No match starts this close to the end
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t n;
+    memcpy(&n, p, 4);
+    return n;
+}
+
+static void length(std::vector<uint8_t>& out, size_t n) {
+    for (; n >= 255; n -= 255) {
+        out.push_back(255);
+    }
+    out.push_back(n);
+}
+
+static void sequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t count, size_t offset, size_t match) {
+    uint8_t literalNibble = count < 15 ? count : 15;
+    uint8_t matchNibble = offset ? (match - MIN_MATCH < 15 ? match - MIN_MATCH : 15) : 0;
+    out.push_back(literalNibble << 4 | matchNibble);
+    if (count >= 15) length(out, count - 15);
+    out.insert(out.end(), literals, literals + count);
+    if (!offset) return;
+    out.push_back(offset);
+    out.push_back(offset >> 8);
+    if (match - MIN_MATCH >= 15) length(out, match - MIN_MATCH - 15);
+}
+
+// Greedy single-probe matcher, the skip grows over incompressible stretches
+void LZ4::compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+    uint32_t table[1 << HASH_BITS] = {};
+    size_t anchor = 0;
+    size_t i = 1;
+    size_t misses = 0;
+
+    while (size > MATCH_LIMIT && i < size - MATCH_LIMIT) {
+        uint32_t sequenceBytes = read32(in + i);
+        uint32_t hash = (sequenceBytes * 2654435761u) >> (32 - HASH_BITS);
+        size_t ref = table[hash];
+        table[hash] = i;
+        if (i - ref > 0xFFFF || read32(in + ref) != sequenceBytes) {
+            i += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+        while (ref > 0 && i > anchor && in[ref - 1] == in[i - 1]) {
+            --ref;
+            --i;
+        }
+        size_t end = i + MIN_MATCH;
+        while (end < size - LAST_LITERALS && in[end] == in[ref + end - i]) {
+            ++end;
+        }
+        sequence(out, in + anchor, i - anchor, i - ref, end - i);
+        i = anchor = end;
+    }
+    sequence(out, in + anchor, size - anchor, 0, 0);
+}
+
+// Fails on anything that would read or write out of bounds or not fill out exactly
+bool LZ4::decompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize) {
+    const uint8_t* end = in + size;
+    size_t position = 0;
+
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t count = token >> 4;
+        if (count == 15) {
+            uint8_t n;
+            do {
+                if (in == end) return false;
+                n = *in++;
+                count += n;
+            } while (n == 255);
+        }
+        if ((size_t) (end - in) < count || outSize - position < count) return false;
+        memcpy(out + position, in, count);
+        in += count;
+        position += count;
+        if (in == end) break; // Last sequence, literals only
+
+        if (end - in < 2) return false;
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        size_t match = (token & 0xF) + MIN_MATCH;
+        if ((token & 0xF) == 15) {
+            uint8_t n;
+            do {
+                if (in == end) return false;
+                n = *in++;
+                match += n;
+            } while (n == 255);
+        }
+        if (offset == 0 || offset > position || outSize - position < match) return false;
+        // Byte by byte, a match may overlap the bytes it produces
+        for (size_t j = 0; j < match; ++j, ++position) {
+            out[position] = out[position - offset];
+        }
+    }
+    return position == outSize;
+}
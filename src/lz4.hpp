@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// LZ4 block format: a token with 4 bit literal and match lengths, the
+// literals, then a 16 bit back reference. No frame header, the caller keeps the size.
+class LZ4 {
+    public:
+        static void compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out);
+        static bool decompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize);
+};
@@ -1,11 +1,49 @@
+#include <algorithm>
+#include <ctime>
+
 #include "mbc.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+
+MBC::MBC(ROM& rom, Pages& ram, int romSize, int ramSize)
+    : rom(rom), ram(ram), romSize(romSize), ramSize(ramSize) {
+    ramMask = (ramSize < 0x2000 ? ramSize : 0x2000) - 1;
+}
+
+uint8_t* MBC::romBase(int bank) {
+    return rom.data + (bank << 14) % romSize;
+}
+
+// Offset of a RAM bank. Banks smaller than the 8 KiB window are mirrored, directly mapped from 256 bytes
+int MBC::ramBase(int bank) {
+    if (ramSize < 0x100) {
+        return -1;
+    }
+    return (bank << 13) % ramSize;
+}
+
 
 // ROM
+MBC0::MBC0(ROM& rom, Pages& ram, int ramSize)
+    : MBC(rom, ram, rom.size, ramSize) {
+    ramg = 1;
+    map();
+}
+
+void MBC0::map() {
+    rom0 = romBase(0);
+    romx = romBase(1);
+    sramRead = ramBase(0);
+    sramWrite = ramBase(0);
+}
+
 uint8_t MBC0::read(uint16_t address) {
-    if (address <= 0x7FFF) {
-        return rom[address];
+    if (address <= 0x3FFF) {
+        return rom0[address];
+    } else if (address <= 0x7FFF) {
+        return romx[address & 0x3FFF];
     } else if (address >= 0xA000 && address <= 0xBFFF) {
-        return ram[(address - 0xA000) % ramSize];
+        return ram.get((address - 0xA000) % ramSize);
     } else {
         return 0xFF;
     }
@@ -13,23 +51,41 @@ uint8_t MBC0::read(uint16_t address) {
 
 void MBC0::write(uint16_t address, uint8_t n) {
     if (address >= 0xA000 && address <= 0xBFFF) {
-        ram[(address - 0xA000) % ramSize] = n;
+        ram.set((address - 0xA000) % ramSize, n);
+    }
+}
+
+void MBC0::serialize(State& state) {
+    if (state.loading) {
+        map();
     }
 }
 
 
 // MBC1
+MBC1::MBC1(ROM& rom, Pages& ram, int romSize, int ramSize)
+    : MBC(rom, ram, romSize, ramSize) {
+    map();
+}
+
+void MBC1::map() {
+    romBank = (mode ? (bank2 << 5) : 0);
+    rom0 = romBase(romBank);
+    romBank = ((bank2 << 5) | bank1);
+    romx = romBase(romBank);
+    ramBank = (mode ? bank2 : 0);
+    sramRead = ramg ? ramBase(ramBank) : -1;
+    sramWrite = sramRead;
+}
+
 uint8_t MBC1::read(uint16_t address) {
     if (address <= 0x3FFF) {
-        romBank = (mode ? (bank2 << 5) : 0);
-        return rom[((romBank << 14) | (address & 0x3FFF)) % romSize];
+        return rom0[address];
     } else if (address <= 0x7FFF) {
-        romBank = ((bank2 << 5) | bank1);
-        return rom[((romBank << 14) | (address & 0x3FFF)) % romSize];
+        return romx[address & 0x3FFF];
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
-            ramBank = (mode ? bank2 : 0);
-            return ram[((ramBank << 13) | (address & 0x1FFF)) % ramSize];
+            return ram.get(((ramBank << 13) | (address & 0x1FFF)) % ramSize);
         } else {
             return 0xFF;
         }
@@ -41,33 +97,61 @@ uint8_t MBC1::read(uint16_t address) {
 void MBC1::write(uint16_t address, uint8_t n) {
     if (address <= 0x1FFF) {
         ramg = ((n & 0x0F) == 0x0A);
+        map();
     } else if (address <= 0x3FFF) {
         n &= 0x1F;
         if (n == 0) {
             n = 0x1;
         }
         bank1 = n;
+        map();
     } else if (address <= 0x5FFF) {
         bank2 = n & 0x3;
+        map();
     } else if (address <= 0x7FFF) {
         mode = n & 0x1;
+        map();
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
-            ramBank = (mode ? bank2 : 0);
-            ram[((ramBank << 13) | (address & 0x1FFF)) % ramSize] = n;
+            ram.set(((ramBank << 13) | (address & 0x1FFF)) % ramSize, n);
         }
     }
 }
 
+// romBank and ramBank follow from the registers, map() recomputes them
+void MBC1::serialize(State& state) {
+    state.value(ramg);
+    state.value(bank1);
+    state.value(bank2);
+    state.value(mode);
+    if (state.loading) {
+        map();
+    }
+}
+
+
 // MBC2
+MBC2::MBC2(ROM& rom, Pages& ram, int romSize, int ramSize)
+    : MBC(rom, ram, romSize, ramSize) {
+    map();
+}
+
+// Writes keep the upper nibble set, so only reads are mapped
+void MBC2::map() {
+    rom0 = romBase(0);
+    romx = romBase(romb);
+    sramRead = ramg ? ramBase(0) : -1;
+    sramWrite = -1;
+}
+
 uint8_t MBC2::read(uint16_t address) {
     if (address <= 0x3FFF) {
-        return rom[address];
+        return rom0[address];
     } else if (address <= 0x7FFF) {
-        return rom[((romb << 14) | (address & 0x3FFF)) % romSize];
+        return romx[address & 0x3FFF];
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
-            return ram[address % ramSize];
+            return ram.get(address % ramSize);
         } else {
             return 0xFF;
         }
@@ -84,26 +168,50 @@ void MBC2::write(uint16_t address, uint8_t n) {
         } else {
             romb = n == 0 ? 0x1 : n;
         }
+        map();
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
-            ram[address % ramSize] = n | 0xF0;
+            ram.set(address % ramSize, n | 0xF0);
         }
     }
 }
 
+void MBC2::serialize(State& state) {
+    state.value(ramg);
+    state.value(romb);
+    if (state.loading) {
+        map();
+    }
+}
+
 
 // MBC3
+static const uint8_t RTC_MASK[5] = {0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+
+MBC3::MBC3(ROM& rom, Pages& ram, int romSize, int ramSize, Scheduler& scheduler)
+    : MBC(rom, ram, romSize, ramSize), scheduler(scheduler) {
+    base = scheduler.cycles;
+    map();
+}
+
+void MBC3::map() {
+    rom0 = romBase(0);
+    romx = romBase(romBank);
+    sramRead = (ramg && ramBank <= 0x3) ? ramBase(ramBank) : -1;
+    sramWrite = sramRead;
+}
+
 uint8_t MBC3::read(uint16_t address) {
     if (address <= 0x3FFF) {
-        return rom[address];
+        return rom0[address];
     } else if (address <= 0x7FFF) {
-        return rom[((romBank << 14) | (address & 0x3FFF)) % romSize];
+        return romx[address & 0x3FFF];
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
             if (ramBank <= 0x3) {
-                return ram[((ramBank << 13) | (address & 0x1FFF)) % ramSize];
+                return ram.get(((ramBank << 13) | (address & 0x1FFF)) % ramSize);
             } else if (ramBank >= 0x08 && ramBank <= 0x0C) {
-                return RTC[ramBank - 0x08];
+                return latched[ramBank - 0x08];
             } else {
                 return 0xFF;
             }
@@ -118,38 +226,150 @@ uint8_t MBC3::read(uint16_t address) {
 void MBC3::write(uint16_t address, uint8_t n) {
     if (address <= 0x1FFF) {
         ramg = ((n & 0x0F) == 0x0A);
+        map();
     } else if (address <= 0x3FFF) {
         n &= 0x7F;
         if (n == 0) {
             n = 0x1;
         }
         romBank = n;
+        map();
     } else if (address <= 0x5FFF) {
         ramBank = n;
+        map();
     } else if (address <= 0x7FFF) {
-        ;
+        if (latch == 0x00 && n == 0x01) {
+            update();
+            std::copy(RTC, RTC + 5, latched);
+        }
+        latch = n;
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
             if (ramBank <= 0x3) {
-                ram[((ramBank << 13) | (address & 0x1FFF)) % ramSize] = n;
+                ram.set(((ramBank << 13) | (address & 0x1FFF)) % ramSize, n);
             } else if (ramBank >= 0x08 && ramBank <= 0x0C) {
-                RTC[ramBank - 0x08] = n;
+                update();
+                RTC[ramBank - 0x08] = n & RTC_MASK[ramBank - 0x08];
+                latched[ramBank - 0x08] = n & RTC_MASK[ramBank - 0x08];
+                if (ramBank == 0x08) {
+                    base = scheduler.cycles; // Writing seconds restarts the second
+                }
             }
         }
     }
 }
 
+void MBC3::serialize(State& state) {
+    state.value(ramg);
+    state.value(romBank);
+    state.value(ramBank);
+    state.bytes(RTC, sizeof(RTC));
+    state.bytes(latched, sizeof(latched));
+    state.value(latch);
+    state.value(base);
+    if (state.loading) {
+        map();
+    }
+}
+
+// Whole seconds since base, a reset or a halted clock only moves base
+void MBC3::update() {
+    const uint64_t SECOND = 4194304;
+    if (scheduler.cycles < base || (RTC[4] & 0x40)) {
+        base = scheduler.cycles;
+        return;
+    }
+    uint64_t seconds = (scheduler.cycles - base) / SECOND;
+    base += seconds * SECOND;
+    advance(seconds);
+}
+
+// Out of range values count a second at a time until they wrap, then the rest
+// is one division
+void MBC3::advance(uint64_t seconds) {
+    for (; seconds && (RTC[0] >= 60 || RTC[1] >= 60 || RTC[2] >= 24); --seconds) {
+        step();
+    }
+    if (!seconds) {
+        return;
+    }
+    uint64_t time = seconds + RTC[0] + RTC[1] * 60 + RTC[2] * 3600;
+    uint64_t days = ((RTC[4] & 0x01) << 8 | RTC[3]) + time / 86400;
+    time %= 86400;
+    RTC[0] = time % 60;
+    RTC[1] = time / 60 % 60;
+    RTC[2] = time / 3600;
+    RTC[3] = days & 0xFF;
+    RTC[4] = (RTC[4] & 0xFE) | ((days >> 8) & 0x01) | (days >= 512 ? 0x80 : 0); // Day carry stays until written
+}
+
+// Registers are 6, 6, 5 and 9 bits wide, values past 59, 59 and 23 wrap to 0 without a carry
+void MBC3::step() {
+    if ((RTC[0] = (RTC[0] + 1) & 0x3F) != 60) return;
+    RTC[0] = 0;
+    if ((RTC[1] = (RTC[1] + 1) & 0x3F) != 60) return;
+    RTC[1] = 0;
+    if ((RTC[2] = (RTC[2] + 1) & 0x1F) != 24) return;
+    RTC[2] = 0;
+    if (++RTC[3] == 0) {
+        RTC[4] = RTC[4] & 0x01 ? (RTC[4] & 0xFE) | 0x80 : RTC[4] | 0x01;
+    }
+}
+
+// Live and latched registers as 32-bit words, then the host time as 64 bits
+void MBC3::saveClock(uint8_t* clock) {
+    update();
+    uint64_t now = std::time(nullptr);
+    std::fill_n(clock, CLOCK, 0);
+    for (int i = 0; i < 5; ++i) {
+        clock[i * 4] = RTC[i];
+        clock[20 + i * 4] = latched[i];
+    }
+    for (int i = 0; i < 8; ++i) {
+        clock[40 + i] = now >> (i * 8);
+    }
+}
+
+// The clock kept running on the cartridge battery while the emulator was closed
+void MBC3::loadClock(const uint8_t* clock) {
+    uint64_t saved = 0;
+    for (int i = 0; i < 5; ++i) {
+        RTC[i] = clock[i * 4] & RTC_MASK[i];
+        latched[i] = clock[20 + i * 4] & RTC_MASK[i];
+    }
+    for (int i = 0; i < 8; ++i) {
+        saved |= (uint64_t) clock[40 + i] << (i * 8);
+    }
+    uint64_t now = std::time(nullptr);
+    if (saved && now > saved && !(RTC[4] & 0x40)) {
+        advance(now - saved);
+    }
+    base = scheduler.cycles;
+}
+
 
 // MBC5
+MBC5::MBC5(ROM& rom, Pages& ram, int romSize, int ramSize)
+    : MBC(rom, ram, romSize, ramSize) {
+    map();
+}
+
+void MBC5::map() {
+    rom0 = romBase(0);
+    romBank = ((bank2 << 8) | bank1);
+    romx = romBase(romBank);
+    sramRead = ramg ? ramBase(ramBank) : -1;
+    sramWrite = sramRead;
+}
+
 uint8_t MBC5::read(uint16_t address) {
     if (address <= 0x3FFF) {
-        return rom[address];
+        return rom0[address];
     } else if (address <= 0x7FFF) {
-        romBank = ((bank2 << 8) | bank1);
-        return rom[((romBank << 14) | (address & 0x3FFF)) % romSize];
+        return romx[address & 0x3FFF];
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
-            return ram[((ramBank << 13) | (address & 0x1FFF)) % ramSize];
+            return ram.get(((ramBank << 13) | (address & 0x1FFF)) % ramSize);
         } else {
             return 0xFF;
         }
@@ -161,15 +381,29 @@ uint8_t MBC5::read(uint16_t address) {
 void MBC5::write(uint16_t address, uint8_t n) {
     if (address <= 0x1FFF) {
         ramg = (n == 0x0A);
+        map();
     } else if (address <= 0x2FFF) {
         bank1 = n;
+        map();
     } else if (address <= 0x3FFF) {
         bank2 = n & 0x1;
+        map();
     } else if (address <= 0x5FFF) {
         ramBank = n & 0xF;
+        map();
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         if (ramg) {
-            ram[((ramBank << 13) | (address & 0x1FFF)) % ramSize] = n;
+            ram.set(((ramBank << 13) | (address & 0x1FFF)) % ramSize, n);
         }
     }
 }
+
+void MBC5::serialize(State& state) {
+    state.value(ramg);
+    state.value(bank1);
+    state.value(bank2);
+    state.value(ramBank);
+    if (state.loading) {
+        map();
+    }
+}
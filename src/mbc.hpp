@@ -3,96 +3,110 @@
 #include <cstdint>
 #include <vector>
 
+#include "pages.hpp"
+#include "rom.hpp"
+
+class State;
+class Scheduler;
+
+// Bank pointers are recomputed whenever a bank register is written
 class MBC {
     public:
-        virtual uint8_t read(uint16_t address) = 0;
-        virtual void write(uint16_t address, uint8_t n) = 0;
-        virtual ~MBC() {}
+        uint8_t* rom0 = nullptr;      // 0x0000-0x3FFF
+        uint8_t* romx = nullptr;      // 0x4000-0x7FFF
+        int sramRead = -1;  // 0xA000-0xBFFF bank offset in ram, -1 goes through read
+        int sramWrite = -1; // 0xA000-0xBFFF bank offset in ram, -1 goes through write
+        bool ramg = 0;      // RAM enabled, clock registers included
+        uint16_t ramMask;
+
+    protected:
+        ROM& rom;
+        Pages& ram;
+        int romSize;
+        int ramSize;
+        uint8_t* romBase(int bank);
+        int ramBase(int bank);
+        MBC(ROM& rom, Pages& ram, int romSize, int ramSize);
 };
 
 class MBC0 : public MBC {
     private:
-        std::vector<uint8_t>& rom;
-        std::vector<uint8_t>& ram;
-        int ramSize;
+        void map();
 
     public:
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
-
-        MBC0(std::vector<uint8_t>& rom, std::vector<uint8_t>& ram, int ramSize)
-            : rom(rom), ram(ram), ramSize(ramSize) {}
+        void serialize(State& state);
+        MBC0(ROM& rom, Pages& ram, int ramSize);
 };
 
 class MBC1 : public MBC {
     private:
-        std::vector<uint8_t>& rom;
-        std::vector<uint8_t>& ram;
-        bool ramg = 0;
-        int romSize;
-        int ramSize;
         uint8_t bank1 = 1;
         uint8_t bank2 = 0;
         uint8_t romBank = 0;
         uint8_t ramBank = 0;
         bool mode = 0;
+        void map();
 
     public:
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
-        MBC1(std::vector<uint8_t>& rom, std::vector<uint8_t>& ram, int romSize, int ramSize)
-            : rom(rom), ram(ram), romSize(romSize), ramSize(ramSize) {}
+        void serialize(State& state);
+        MBC1(ROM& rom, Pages& ram, int romSize, int ramSize);
 };
 
 class MBC2 : public MBC {
     private:
-        std::vector<uint8_t>& rom;
-        std::vector<uint8_t>& ram;
-        bool ramg = 0;
-        int romSize;
-        int ramSize;
         uint8_t romb = 1;
+        void map();
 
     public:
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
-        MBC2(std::vector<uint8_t>& rom, std::vector<uint8_t>& ram, int romSize, int ramSize)
-            : rom(rom), ram(ram), romSize(romSize), ramSize(ramSize) {}
+        void serialize(State& state);
+        MBC2(ROM& rom, Pages& ram, int romSize, int ramSize);
 };
 
+// The RTC counts emulated time. It is only brought up to date when the game
+// latches or writes it, so running uncapped fast-forwards it for free.
 class MBC3 : public MBC {
     private:
-        std::vector<uint8_t>& rom;
-        std::vector<uint8_t>& ram;
-        bool ramg = 0;
-        int romSize;
-        int ramSize;
+        Scheduler& scheduler;
         uint8_t romBank = 1;
         uint8_t ramBank = 0;
-        uint8_t RTC[5] = {};
+        uint8_t RTC[5] = {};     // S, M, H, DL, DH as they count
+        uint8_t latched[5] = {}; // What the game reads, copied from RTC by writing 0 then 1
+        uint8_t latch = 0xFF;
+        uint64_t base;           // Cycle the RTC is current to
+        void map();
+        void update();
+        void advance(uint64_t seconds);
+        void step();
 
     public:
+        // Bytes after the RAM in a .sav, laid out like other emulators write them
+        static const size_t CLOCK = 48;
+
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
-        MBC3(std::vector<uint8_t>& rom, std::vector<uint8_t>& ram, int romSize, int ramSize)
-            : rom(rom), ram(ram), romSize(romSize), ramSize(ramSize) {}
+        void serialize(State& state);
+        void saveClock(uint8_t* clock);
+        void loadClock(const uint8_t* clock);
+        MBC3(ROM& rom, Pages& ram, int romSize, int ramSize, Scheduler& scheduler);
 };
 
 class MBC5 : public MBC {
     private:
-        std::vector<uint8_t>& rom;
-        std::vector<uint8_t>& ram;
-        int romSize;
-        int ramSize;
-        bool ramg = 0;
         uint8_t bank1 = 1;
         uint8_t bank2 = 0;
         uint16_t romBank = 0;
         uint8_t ramBank = 0;
+        void map();
 
     public:
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
-        MBC5(std::vector<uint8_t>& rom, std::vector<uint8_t>& ram, int romSize, int ramSize)
-            : rom(rom), ram(ram), romSize(romSize), ramSize(ramSize) {}
+        void serialize(State& state);
+        MBC5(ROM& rom, Pages& ram, int romSize, int ramSize);
 };
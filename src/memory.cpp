@@ -1,40 +1,45 @@
+#include <algorithm>
+#include <cassert>
+
 #include "memory.hpp"
 #include "cartridge.hpp"
 #include "joypad.hpp"
 #include "timer.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+#include "ppu.hpp"
+
+static const uint8_t BOOT[0x100] = {
+    0x31, 0xFE, 0xFF, 0xAF, 0x21, 0xFF, 0x9F, 0x32, 0xCB, 0x7C, 0x20, 0xFB, 0x21, 0x26, 0xFF, 0x0E,
+    0x11, 0x3E, 0x80, 0x32, 0xE2, 0x0C, 0x3E, 0xF3, 0xE2, 0x32, 0x3E, 0x77, 0x77, 0x3E, 0xFC, 0xE0,
+    0x47, 0x11, 0xA8, 0x00, 0x21, 0x10, 0x80, 0x1A, 0xCD, 0x95, 0x00, 0xCD, 0x96, 0x00, 0x13, 0x7B,
+    0xFE, 0xD8, 0x20, 0xF3, 0x11, 0xD8, 0x00, 0x06, 0x08, 0x1A, 0x13, 0x22, 0x23, 0x05, 0x20, 0xF9,
+    0x3E, 0x19, 0xEA, 0x10, 0x99, 0x21, 0x2F, 0x99, 0x0E, 0x0C, 0x3D, 0x28, 0x08, 0x32, 0x0D, 0x20,
+    0xF9, 0x2E, 0x0F, 0x18, 0xF3, 0x67, 0x3E, 0x64, 0x57, 0xE0, 0x42, 0x3E, 0x91, 0xE0, 0x40, 0x04,
+    0x1E, 0x02, 0x0E, 0x0C, 0xF0, 0x44, 0xFE, 0x90, 0x20, 0xFA, 0x0D, 0x20, 0xF7, 0x1D, 0x20, 0xF2,
+    0x0E, 0x13, 0x24, 0x7C, 0x1E, 0x83, 0xFE, 0x62, 0x28, 0x06, 0x1E, 0xC1, 0xFE, 0x64, 0x20, 0x06,
+    0x7B, 0xE2, 0x0C, 0x3E, 0x87, 0xE2, 0xF0, 0x42, 0x90, 0xE0, 0x42, 0x15, 0x20, 0xD2, 0x05, 0x20,
+    0x4F, 0x16, 0x20, 0x18, 0xCB, 0x4F, 0x06, 0x04, 0xC5, 0xCB, 0x11, 0x17, 0xC1, 0xCB, 0x11, 0x17,
+    0x05, 0x20, 0xF5, 0x22, 0x23, 0x22, 0x23, 0xC9, 0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0C, 0x00, 0x0F,
+    0x00, 0x01, 0x00, 0x0E, 0x36, 0x66, 0xC6, 0x60, 0xFC, 0xCF, 0x8D, 0xD9, 0xCE, 0xFF, 0x6F, 0xFF,
+    0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDC, 0x98, 0x9F, 0xB3, 0xB1, 0x33, 0x3E, 0x66, 0x63, 0xEE, 0x6E,
+    0xCC, 0xCF, 0xCC, 0xC8, 0xF7, 0x31, 0xEC, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x21, 0x04, 0x01, 0x11, 0xA8, 0x00, 0x1A, 0x13, 0xBE, 0x00, 0x00, 0x23, 0x7D, 0xFE, 0x34, 0x20,
+    0xF5, 0x06, 0x19, 0x78, 0x86, 0x23, 0x05, 0x20, 0xFB, 0x86, 0x20, 0x01, 0x3E, 0x01, 0xE0, 0x50
+};
 
-Memory::Memory(Cartridge& cartridge, Joypad& joypad, Timer& timer)
-    : cartridge(cartridge), joypad(joypad), timer(timer) {
-    vram.reserve(0x2000);
-    wram.reserve(0x2000);
-    oam.reserve(0xA0);
-    io.reserve(0x100);
-    hram.reserve(0x7F);
-    boot = {
-        0x31, 0xFE, 0xFF, 0xAF, 0x21, 0xFF, 0x9F, 0x32, 0xCB, 0x7C, 0x20, 0xFB, 0x21, 0x26, 0xFF, 0x0E,
-        0x11, 0x3E, 0x80, 0x32, 0xE2, 0x0C, 0x3E, 0xF3, 0xE2, 0x32, 0x3E, 0x77, 0x77, 0x3E, 0xFC, 0xE0,
-        0x47, 0x11, 0xA8, 0x00, 0x21, 0x10, 0x80, 0x1A, 0xCD, 0x95, 0x00, 0xCD, 0x96, 0x00, 0x13, 0x7B,
-        0xFE, 0xD8, 0x20, 0xF3, 0x11, 0xD8, 0x00, 0x06, 0x08, 0x1A, 0x13, 0x22, 0x23, 0x05, 0x20, 0xF9,
-        0x3E, 0x19, 0xEA, 0x10, 0x99, 0x21, 0x2F, 0x99, 0x0E, 0x0C, 0x3D, 0x28, 0x08, 0x32, 0x0D, 0x20,
-        0xF9, 0x2E, 0x0F, 0x18, 0xF3, 0x67, 0x3E, 0x64, 0x57, 0xE0, 0x42, 0x3E, 0x91, 0xE0, 0x40, 0x04,
-        0x1E, 0x02, 0x0E, 0x0C, 0xF0, 0x44, 0xFE, 0x90, 0x20, 0xFA, 0x0D, 0x20, 0xF7, 0x1D, 0x20, 0xF2,
-        0x0E, 0x13, 0x24, 0x7C, 0x1E, 0x83, 0xFE, 0x62, 0x28, 0x06, 0x1E, 0xC1, 0xFE, 0x64, 0x20, 0x06,
-        0x7B, 0xE2, 0x0C, 0x3E, 0x87, 0xE2, 0xF0, 0x42, 0x90, 0xE0, 0x42, 0x15, 0x20, 0xD2, 0x05, 0x20,
-        0x4F, 0x16, 0x20, 0x18, 0xCB, 0x4F, 0x06, 0x04, 0xC5, 0xCB, 0x11, 0x17, 0xC1, 0xCB, 0x11, 0x17,
-        0x05, 0x20, 0xF5, 0x22, 0x23, 0x22, 0x23, 0xC9, 0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0C, 0x00, 0x0F,
-        0x00, 0x01, 0x00, 0x0E, 0x36, 0x66, 0xC6, 0x60, 0xFC, 0xCF, 0x8D, 0xD9, 0xCE, 0xFF, 0x6F, 0xFF,
-        0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDC, 0x98, 0x9F, 0xB3, 0xB1, 0x33, 0x3E, 0x66, 0x63, 0xEE, 0x6E,
-        0xCC, 0xCF, 0xCC, 0xC8, 0xF7, 0x31, 0xEC, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x21, 0x04, 0x01, 0x11, 0xA8, 0x00, 0x1A, 0x13, 0xBE, 0x00, 0x00, 0x23, 0x7D, 0xFE, 0x34, 0x20,
-        0xF5, 0x06, 0x19, 0x78, 0x86, 0x23, 0x05, 0x20, 0xFB, 0x86, 0x20, 0x01, 0x3E, 0x01, 0xE0, 0x50
-    };
-    init();
+Memory::Memory(Cartridge& cartridge, Joypad& joypad, Timer& timer, Scheduler& scheduler)
+    : cartridge(cartridge), joypad(joypad), timer(timer), scheduler(scheduler), blocks(*this) {
+    oam.resize(0x100); // DMA writes one byte past the 0xA0 OAM bytes
+    io.resize(0x100);
+    hram.resize(0x7F);
 }
 
 void Memory::init() {
     bootEnabled = false;
-    std::fill_n(vram.begin(), 0x2000, 0);
-    std::fill_n(wram.begin(), 0x2000, 0);
+    vram.allocate(0x2000);
+    wram.allocate(0x2000);
+    tiles.clear();
     std::fill_n(oam.begin(), 0xA0, 0);
     std::fill_n(io.begin(), 0x100, 0xFF);
     std::fill_n(hram.begin(), 0x7F, 0);
@@ -49,13 +54,161 @@ void Memory::init() {
     lcd.obp1 = 0xFF;
     lcd.wy = 0;
     lcd.wx = 0;
+    resolvePalettes();
     dmaAddress = 0;
     dmaCycle = 0xFF;
+    serialOutput.clear();
     write(0xFF01, 0x00); // SB
     write(0xFF02, 0x7E); // SC
     write(0xFF0F, 0x00); // IF
     write(0xFFFF, 0x00); // IE
     bootEnabled = true;
+    map();
+    blocks.reset();
+}
+
+void Memory::load(std::string path, bool battery) {
+    cartridge.load(path, battery);
+    blocks.clear();
+    // The old windows point into the previous ROM
+    std::fill_n(readMap, 0x80, nullptr);
+    std::fill_n(readMap + 0xA0, 0x20, nullptr);
+    std::fill_n(writeMap + 0xA0, 0x20, nullptr);
+    mapCartridge();
+}
+
+// The cartridge is restored first, so the windows can be remapped at the end
+void Memory::serialize(State& state) {
+    vram.serialize(state);
+    wram.serialize(state);
+    state.bytes(oam);
+    state.bytes(io);
+    state.bytes(hram);
+    state.value(lcd.lcdc);
+    state.value(lcd.stat);
+    state.value(lcd.scy);
+    state.value(lcd.scx);
+    state.value(lcd.ly);
+    state.value(lcd.lyc);
+    state.value(lcd.bgp);
+    state.value(lcd.obp0);
+    state.value(lcd.obp1);
+    state.value(lcd.wy);
+    state.value(lcd.wx);
+    state.value(bootEnabled);
+    state.value(dmaAddress);
+    state.value(dmaCycle);
+    if (state.loading) {
+        interruptsChanged = true;
+        resolvePalettes();
+        decodeTiles();
+        map();
+        blocks.reset();
+    }
+}
+
+void Memory::map() {
+    mapCartridge();
+    for (int page = 0x80; page <= 0xFD; ++page) {
+        mapPage(page);
+    }
+}
+
+// VRAM and WRAM pages shared with a fork are read directly, written through write.
+// So are tile data pages, write keeps the decoded tiles in step.
+void Memory::mapPage(int page) {
+    if (page >= 0x80 && page <= 0x9F) {
+        readMap[page] = vram.read(page - 0x80);
+        writeMap[page] = vram.isOwned(page - 0x80) && page >= 0x98 ? readMap[page] : nullptr;
+    } else if (page >= 0xC0 && page <= 0xFD) {
+        int offset = (page - 0xC0) & 0x1F;
+        readMap[page] = wram.read(offset);
+        writeMap[page] = wram.isOwned(offset) ? readMap[page] : nullptr;
+    }
+}
+
+// A fork starts from the same memory, and both sides copy pages as they write
+void Memory::share(Memory& from) {
+    vram.share(from.vram);
+    wram.share(from.wram);
+    oam = from.oam;
+    io = from.io;
+    hram = from.hram;
+    lcd = from.lcd;
+    bootEnabled = from.bootEnabled;
+    dmaAddress = from.dmaAddress;
+    dmaCycle = from.dmaCycle;
+    serialOutput = from.serialOutput;
+    interruptsChanged = true;
+    tiles.share(from.tiles);
+    blocks.clear();
+    map();
+    from.map();
+}
+
+// Called whenever the MBC bank registers or the boot ROM mapping change
+void Memory::mapCartridge() {
+    // A ROM bank is contiguous, one lookup per 16 KiB window
+    for (int window = 0x00; window <= 0x40; window += 0x40) {
+        uint8_t* bank = cartridge.loaded ? cartridge.readPage(window << 8) : nullptr;
+        if (bank && readMap[window + 0x3F] == bank + 0x3F00) {
+            continue;
+        }
+        blocks.invalidate(window >> 6);
+        for (int page = 0; page < 0x40; ++page) {
+            readMap[window + page] = bank ? bank + (page << 8) : nullptr;
+        }
+    }
+    // Likewise the RAM window only moves with its first page
+    if (readMap[0xA0] != cartridge.readPage(0xA000) || writeMap[0xA0] != cartridge.writePage(0xA000)) {
+        mapRAM();
+    }
+    readMap[0x00] = bootEnabled ? (uint8_t*) BOOT : (readMap[0x01] ? readMap[0x01] - 0x100 : nullptr);
+}
+
+void Memory::mapRAM() {
+    for (int page = 0xA0; page <= 0xBF; ++page) {
+        readMap[page] = cartridge.readPage(page << 8);
+        writeMap[page] = cartridge.writePage(page << 8);
+    }
+}
+
+void Memory::resolvePalettes() {
+    const uint8_t registers[3] = {lcd.bgp, lcd.obp0, lcd.obp1};
+    for (int palette = 0; palette < 3; ++palette) {
+        for (int color = 0; color < 4; ++color) {
+            lcd.palettes[palette][color] = PALETTE[(registers[palette] >> (color * 2)) & 0x3];
+        }
+    }
+}
+
+void Memory::decodeTiles() {
+    for (uint16_t offset = 0; offset < 0x1800; offset += 2) {
+        tiles.decode(offset, vram.get(offset), vram.get(offset + 1));
+    }
+}
+
+// Map rows are 32 byte aligned, so a row never crosses a page
+const uint8_t* Memory::tileMap(uint16_t map, int row) {
+    uint16_t address = map + row * 32;
+    return vram.read((address - 0x8000) / Pages::SIZE) + address % Pages::SIZE;
+}
+
+const uint8_t* Memory::tileRow(int tile, int y, bool flipped) {
+    const uint8_t* span = flipped ? tiles.flipped(tile, y) : tiles.row(tile, y);
+#ifndef NDEBUG
+    uint8_t low = vram.get(tile * 16 + y * 2);
+    uint8_t high = vram.get(tile * 16 + y * 2 + 1);
+    for (int x = 0; x < 8; ++x) {
+        int bit = flipped ? x : 7 - x;
+        assert(span[x] == ((((high >> bit) & 0x1) << 1) | ((low >> bit) & 0x1)));
+    }
+#endif
+    return span;
+}
+
+const uint8_t* Memory::objects() {
+    return oam.data();
 }
 
 void Memory::interrupt(uint8_t IRQ) {
@@ -64,33 +217,53 @@ void Memory::interrupt(uint8_t IRQ) {
 
 void Memory::transfer() {
     if (dmaCycle <= 0xA0) {
-        oam[dmaCycle] = read(dmaAddress + dmaCycle);
+        // The 0xA1 source bytes sit in one page, mapped unless it is I/O or cartridge
+        const uint8_t* source = readMap[dmaAddress >> 8];
+        oam[dmaCycle] = source ? source[dmaCycle] : read(dmaAddress + dmaCycle);
         dmaCycle++;
     }
+    if (dmaCycle <= 0xA0) {
+        scheduler.schedule(Scheduler::DMA, scheduler.cycles + 4);
+    } else {
+        scheduler.cancel(Scheduler::DMA);
+    }
+}
+
+void Memory::serial() {
+    scheduler.cancel(Scheduler::SERIAL);
+    if (io[0x02] & 0x80) {
+        io[0x01] = 0xFF; // No link partner
+        io[0x02] &= 0x7F;
+        interrupt(0x08);
+    }
 }
 
 uint8_t Memory::read(uint16_t address) {
+    if (readMap[address >> 8]) {
+        return readMap[address >> 8][address & 0xFF];
+    }
+
     if (address < 0x100 && bootEnabled) {
-        return boot[address];
+        return BOOT[address];
     } else if (address <= 0x7FFF && cartridge.loaded == true) {
         return cartridge.read(address);
     } else if (address >= 0x8000 && address <= 0x9FFF) {
-        return vram[address - 0x8000];
+        return vram.get(address - 0x8000);
     } else if (address >= 0xA000 && address <= 0xBFFF) {
         return cartridge.read(address);
     } else if (address >= 0xC000 && address <= 0xDFFF) {
-        return wram[address - 0xC000];
+        return wram.get(address - 0xC000);
     } else if (address >= 0xE000 && address <= 0xFDFF) {
-        return wram[address - 0xE000];
+        return wram.get(address - 0xE000);
     } else if (address >= 0xFE00 && address <= 0xFE9F) {
         return oam[address - 0xFE00];
     } else if ((address >= 0xFF00 && address <= 0xFF7F) || address == 0xFFFF) {
         switch (address) {
             case 0xFF00: return joypad.read();
-            case 0xFF04: return timer.divider;
-            case 0xFF05: return timer.tima;
-            case 0xFF06: return timer.tma;
-            case 0xFF07: return timer.tac | 0xF8;
+            case 0xFF04:
+            case 0xFF05:
+            case 0xFF06:
+            case 0xFF07: return timer.read(address);
             case 0xFF13: return 0xFF; // NR13
             case 0xFF40: return lcd.lcdc;
             case 0xFF41: return lcd.stat | 0x80;
@@ -115,45 +288,78 @@ uint8_t Memory::read(uint16_t address) {
 }
 
 void Memory::write(uint16_t address, uint8_t n) {
+    if (writeMap[address >> 8]) {
+        writeMap[address >> 8][address & 0xFF] = n;
+        return;
+    }
+
     if (address <= 0x7FFF && cartridge.loaded == true) {
         cartridge.write(address, n);
+        mapCartridge();
     } else if (address >= 0x8000 && address <= 0x9FFF) {
-        vram[address - 0x8000] = n;
+        vram.set(address - 0x8000, n);
+        mapPage(address >> 8);
+        if (address <= 0x97FF) {
+            uint16_t offset = (address - 0x8000) & ~1;
+            tiles.decode(offset, vram.get(offset), vram.get(offset + 1));
+        }
     } else if (address >= 0xA000 && address <= 0xBFFF) {
-        cartridge.write(address, n); 
-    } else if (address >= 0xC000 && address <= 0xDFFF) {
-        wram[address - 0xC000] = n;
-    } else if (address >= 0xE000 && address <= 0xFDFF) {
-        wram[address - 0xE000] = n;
+        cartridge.write(address, n);
+        // The first write to a shared RAM page gives it a copy, mirrors included
+        if (writeMap[address >> 8] != cartridge.writePage(address)) {
+            mapRAM();
+        }
+    } else if (address >= 0xC000 && address <= 0xFDFF) {
+        wram.set((address - 0xC000) & 0x1FFF, n);
+        mapPage(address >> 8);
+        mapPage((address >> 8) ^ 0x20);
     } else if (address >= 0xFE00 && address <= 0xFE9F) {
         oam[address - 0xFE00] = n;
     } else if ((address >= 0xFF00 && address <= 0xFF7F) || address == 0xFFFF) {
         switch (address) {
             case 0xFF00: joypad.write(n); break;
-            case 0xFF04: timer.counter = 0; break;
-            case 0xFF05: timer.tima = n; break;
-            case 0xFF06: timer.tma = n; break;
-            case 0xFF07: timer.tac = n | 0xF8; break;
-            case 0xFF40: lcd.lcdc = n; break;
-            case 0xFF41: lcd.stat = (lcd.stat & 0x7) | (n & 0x78) | 0x80; break;
+            case 0xFF02: // Serial Transfer
+                io[0x02] = n;
+                if ((n & 0x81) == 0x81) {
+                    serialOutput += io[0x01];
+                    scheduler.schedule(Scheduler::SERIAL, scheduler.cycles + 8 * 512);
+                }
+                break;
+            case 0xFF04:
+            case 0xFF05:
+            case 0xFF06:
+            case 0xFF07: timer.write(address, n); break;
+            case 0xFF40:
+                lcd.lcdc = n;
+                scheduler.schedule(Scheduler::LCD, scheduler.cycles + 4);
+                break;
+            case 0xFF41:
+                lcd.stat = (lcd.stat & 0x7) | (n & 0x78) | 0x80;
+                scheduler.schedule(Scheduler::LCD, scheduler.cycles + 4);
+                break;
             case 0xFF42: lcd.scy = n; break;
             case 0xFF43: lcd.scx = n; break;
-            case 0xFF45: lcd.lyc = n; break;
+            case 0xFF45:
+                lcd.lyc = n;
+                scheduler.schedule(Scheduler::LCD, scheduler.cycles + 4);
+                break;
             case 0xFF46: // DMA Transfer
                 io[0x46] = n;
                 if (dmaCycle > 0xA0) {
                     dmaAddress = n << 8;
                     dmaCycle = 0x0;
+                    scheduler.schedule(Scheduler::DMA, scheduler.cycles + 4);
                 }
                 break;
-            case 0xFF47: lcd.bgp = n; break;
-            case 0xFF48: lcd.obp0 = n; break;
-            case 0xFF49: lcd.obp1 = n; break;
+            case 0xFF47: lcd.bgp = n; resolvePalettes(); break;
+            case 0xFF48: lcd.obp0 = n; resolvePalettes(); break;
+            case 0xFF49: lcd.obp1 = n; resolvePalettes(); break;
             case 0xFF4A: lcd.wy = n; break;
             case 0xFF4B: lcd.wx = n; break;
             case 0xFF50:
                 if (n == 0x01 && bootEnabled) {
                     bootEnabled = false;
+                    mapCartridge();
                     write(0xFF10, 0x80); // NR10
                     write(0xFF11, 0xBF); // NR11
                     write(0xFF12, 0xF3); // NR12
@@ -174,8 +380,8 @@ void Memory::write(uint16_t address, uint8_t n) {
                     write(0xFF26, 0xF1); // NR52
                 }
                 break;
-            case 0xFFFF: io[0xFF] = n; break; // IE
-            case 0xFF0F: io[0x0F] = n | 0xE0; break; // IF
+            case 0xFFFF: io[0xFF] = n; interruptsChanged = true; break; // IE
+            case 0xFF0F: io[0x0F] = n | 0xE0; interruptsChanged = true; break; // IF
             default: io[address - 0xFF00] = n; break;
         }
     } else if (address >= 0xFF80 && address <= 0xFFFE) {
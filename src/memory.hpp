@@ -3,15 +3,22 @@
 #include <vector>
 #include <string>
 
+#include "blockcache.hpp"
+#include "pages.hpp"
+#include "tiles.hpp"
+
 class Cartridge;
 class Joypad;
 class Timer;
+class Scheduler;
+class State;
 
 class Memory {
     public:
         Cartridge& cartridge;
         Joypad& joypad;
         Timer& timer;
+        Scheduler& scheduler;
 
         struct {
             uint8_t lcdc;
@@ -25,26 +32,51 @@ class Memory {
             uint8_t obp1;
             uint8_t wy;
             uint8_t wx;
+            uint32_t palettes[3][4]; // BGP, OBP0 and OBP1 as ARGB, updated as they are written
         } lcd;
 
         bool bootEnabled;
         void init();
-        void load(std::string path);
+        void load(std::string path, bool battery);
+        void serialize(State& state);
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t n);
         void interrupt(uint8_t IRQ);
+        bool interruptsChanged = true; // Set on IF/IE writes, cleared by the CPU check
+
+        // Host pointers to each 256 byte page, nullptr goes through read/write
+        uint8_t* readMap[0x100] = {};
+        uint8_t* writeMap[0x100] = {};
+        void map();
+        void share(Memory& from);
+
+        BlockCache blocks;
+        Tiles tiles;
+
+        // Spans for the PPU, read without going through read(). A row of 32 tile numbers
+        // from the map at 0x9800 or 0x9C00, a decoded row of 8 pixels and the 0xA0 bytes
+        // of OAM. Debug builds check decoded rows against the VRAM bytes.
+        const uint8_t* tileMap(uint16_t map, int row);
+        const uint8_t* tileRow(int tile, int y, bool flipped);
+        const uint8_t* objects();
 
         uint16_t dmaAddress;
         uint8_t dmaCycle;
         void transfer();
+        void serial();
+        std::string serialOutput; // Every byte sent with the internal clock since init
 
-        Memory(Cartridge& cartridge, Joypad& joypad, Timer& timer);
+        Memory(Cartridge& cartridge, Joypad& joypad, Timer& timer, Scheduler& scheduler);
 
     private:
-        std::vector<uint8_t> vram;
-        std::vector<uint8_t> wram;
+        Pages vram;
+        Pages wram;
         std::vector<uint8_t> oam;
         std::vector<uint8_t> io;
         std::vector<uint8_t> hram;
-        std::vector<uint8_t> boot;
+        void mapCartridge();
+        void mapRAM();
+        void mapPage(int page);
+        void resolvePalettes();
+        void decodeTiles();
 };
@@ -1,23 +1,47 @@
-#include <chrono>
-
 #include "nicogb.hpp"
+#include "lz4.hpp"
+
+NicoGB::NicoGB() : NicoGB(nullptr) {}
 
-NicoGB::NicoGB() :
-    memory(cartridge, joypad, timer),
+// Members only allocate in init(), so a fork skips what share() would replace
+NicoGB::NicoGB(NicoGB* from) :
+    timer(scheduler),
+    cartridge(scheduler),
+    memory(cartridge, joypad, timer, scheduler),
     ppu(memory),
     cpu(memory, ppu),
     loaded(cartridge.loaded),
     title(cartridge.title),
+    serial(memory.serialOutput),
     framebuffer(ppu.framebuffer) {
-        timer = Timer();
-        joypad = Joypad();
-        cartridge = Cartridge();
-        speed = 0;
-        epoch = std::chrono::high_resolution_clock::from_time_t(0);
-        last = millis();
+        if (!from) {
+            init();
+            return;
+        }
+        cartridge.share(from->cartridge);
+        memory.share(from->memory);
+        ppu.share(from->ppu);
+        from->snapshot.start(false);
+        from->scheduler.serialize(from->snapshot);
+        from->cpu.serialize(from->snapshot);
+        from->timer.serialize(from->snapshot);
+        from->joypad.serialize(from->snapshot);
+        from->snapshot.start(true);
+        scheduler.serialize(from->snapshot);
+        cpu.serialize(from->snapshot);
+        timer.serialize(from->snapshot);
+        joypad.serialize(from->snapshot);
+#ifdef JIT
+        cpu.jit.enabled = from->cpu.jit.enabled;
+#endif
+        target = from->target;
+        synced = from->synced;
 }
 
 void NicoGB::init() {
+    target = 0;
+    synced = 0;
+    scheduler.init();
     cpu.init();
     timer.init();
     joypad.reset();
@@ -25,35 +49,182 @@ void NicoGB::init() {
     ppu.init();
 }
 
-std::chrono::_V2::system_clock::time_point NicoGB::now() {
-    return std::chrono::high_resolution_clock::now();
+// Battery backed RAM is kept in a .sav next to the ROM unless battery is false,
+// for runs that must not depend on or change it
+void NicoGB::load(std::string path, bool battery) {
+    init();
+    memory.load(path, battery);
 }
 
-int64_t NicoGB::millis() {
-    return std::chrono::duration_cast
-    <std::chrono::milliseconds>(now() - epoch).count();
+// Runs a budget of T-cycles without consulting the clock. Budgets accumulate,
+// so an instruction running past the end is taken from the next call.
+void NicoGB::runCycles(uint64_t cycles) {
+    target += cycles;
+    while (cartridge.loaded && scheduler.cycles < target) {
+        step(target);
+    }
 }
 
-void NicoGB::load(std::string path) {
-    init();
-    cartridge.load(path);
+// Runs until the PPU enters V-Blank. While the LCD is off no frame is drawn,
+// so the call gives up after a frame's worth of cycles. Returns whether V-Blank
+// was reached, the framebuffer then holds the last frame drawn, see renderEvery().
+bool NicoGB::runFrame() {
+    uint64_t end = scheduler.cycles + FRAME;
+    ppu.frame = false;
+    while (cartridge.loaded && !ppu.frame && scheduler.cycles < end) {
+        step(end);
+    }
+    target = scheduler.cycles;
+    return ppu.frame;
 }
 
-void NicoGB::tick() {
-    if (speed) {
-        cpu.totalCycles = 0;
+// Runs up to the next event or end, and syncs the .sav every SYNC cycles however
+// the caller steps
+void NicoGB::step(uint64_t end) {
+    cpu.cycle(end);
+    if (!cartridge.speculative && scheduler.cycles - synced >= SYNC) {
+        cartridge.sync(false);
+        synced = scheduler.cycles;
     }
+}
 
-    if (cartridge.loaded && cpu.totalCycles < 70224) {
-        cpu.cycle();
+// Runs the real frame, then frames more with the same input, and returns what
+// the screen will look like then before rolling back. Games take a frame or
+// more to react to input, this hides that many frames of it.
+// Only the last frame ahead is drawn, none of those before it are ever shown, and
+// framebuffer then holds it too, so states taken after rewind to what was on screen.
+const std::vector<uint32_t>& NicoGB::runAhead(unsigned frames) {
+    if (frames == 0 || !cartridge.loaded) {
+        runFrame();
+        return ppu.framebuffer;
     }
+    unsigned interval = ppu.interval;
+    ppu.interval = 0;
+    ppu.requested = false;
+    runFrame();
+    // A state we just took can't fail, so no header or backup
+    size_t serialSize = memory.serialOutput.size();
+    snapshot.start(false);
+    serialize(snapshot);
+    cartridge.speculative = true;
+    for (unsigned i = 0; i < frames; ++i) {
+        if (i + 1 == frames) {
+            ppu.requested = true;
+        }
+        runFrame();
+    }
+    cartridge.speculative = false;
+    ppu.interval = interval;
+    ahead.swap(ppu.framebuffer);
+    ppu.framebuffer.resize(ahead.size());
+    snapshot.start(true);
+    serialize(snapshot);
+    memory.serialOutput.resize(serialSize);
+    ppu.framebuffer = ahead;
+    target = scheduler.cycles;
+    return ahead;
+}
 
-    if (millis() - last >= 1000/60) {
-        last = millis();
-        if (cartridge.loaded && !speed) {
-            cpu.totalCycles -= 70224;
+// T-cycles run since the last init or load
+uint64_t NicoGB::cycles() {
+    return scheduler.cycles;
+}
+
+Registers NicoGB::registers() {
+    return cpu.registers();
+}
+
+// The cartridge goes first, a state for another ROM fails before anything else is read
+void NicoGB::serialize(State& state) {
+    cartridge.serialize(state);
+    scheduler.serialize(state);
+    cpu.serialize(state);
+    timer.serialize(state);
+    joypad.serialize(state);
+    memory.serialize(state);
+    ppu.serialize(state);
+}
+
+// Header of magic, version, flags and payload size, then the payload, LZ4 compressed
+// with compress. A typical cart is ~40 KiB raw and a fraction of that compressed.
+void NicoGB::saveState(std::vector<uint8_t>& out, bool compress) {
+    state.start(false);
+    serialize(state);
+
+    State header;
+    uint32_t magic = State::MAGIC;
+    uint16_t version = State::VERSION;
+    uint16_t flags = compress ? State::COMPRESSED : 0;
+    uint32_t size = state.data.size();
+    header.value(magic);
+    header.value(version);
+    header.value(flags);
+    header.value(size);
+
+    out = header.data;
+    if (compress) {
+        LZ4::compress(state.data.data(), size, out);
+    } else {
+        out.insert(out.end(), state.data.begin(), state.data.end());
+    }
+}
+
+bool NicoGB::loadState(const std::vector<uint8_t>& in) {
+    const size_t HEADER = 12;
+    if (!cartridge.loaded || in.size() < HEADER) {
+        return false;
+    }
+    State header;
+    uint32_t magic, size;
+    uint16_t version, flags;
+    header.data.assign(in.begin(), in.begin() + HEADER);
+    header.start(true);
+    header.value(magic);
+    header.value(version);
+    header.value(flags);
+    header.value(size);
+    if (magic != State::MAGIC || version != State::VERSION) {
+        return false;
+    }
+
+    // A state for this ROM is the size of one taken now, give or take the blank
+    // bitmaps of the two framebuffers, so a corrupt size is caught before allocating
+    backup.start(false);
+    serialize(backup);
+    if (size > backup.data.size() + 160 * 144 / 4) {
+        return false;
+    }
+
+    state.data.resize(size);
+    if (flags & State::COMPRESSED) {
+        if (!LZ4::decompress(in.data() + HEADER, in.size() - HEADER, state.data.data(), size)) {
+            return false;
         }
+    } else if (in.size() - HEADER == size) {
+        std::copy(in.begin() + HEADER, in.end(), state.data.begin());
+    } else {
+        return false;
+    }
+
+    state.start(true);
+    serialize(state);
+    if (!state.ok || state.position != size) {
+        backup.start(true);
+        serialize(backup);
+        return false;
     }
+    target = scheduler.cycles;
+    synced = scheduler.cycles;
+    return true;
+}
+
+// A new instance in the same state, for searches and speculative runs. The ROM,
+// cartridge RAM, VRAM and WRAM are shared and copied a 256 byte page at a time
+// as either side writes, so are the decoded tiles. The framebuffers aren't, a
+// fork's are empty until it draws a frame of its own. The rest is copied, a few
+// KiB, most of it the NicoGB itself.
+std::unique_ptr<NicoGB> NicoGB::fork() {
+    return std::unique_ptr<NicoGB>(new NicoGB(this));
 }
 
 void NicoGB::keyDown(Key key) {
@@ -80,3 +251,34 @@ void NicoGB::serialTransferWrite(bool value) {
     uint8_t serialControl = memory.read(0xFF02) & 0x1;
     memory.write(0xFF02, (value << 7) | serialControl);
 }
+
+const BlockCache::Stats& NicoGB::blockStats() {
+    return memory.blocks.stats;
+}
+
+bool NicoGB::jitAvailable() {
+#ifdef JIT
+    return cpu.jit.available();
+#else
+    return false;
+#endif
+}
+
+void NicoGB::useJit(bool enabled) {
+#ifdef JIT
+    cpu.jit.enabled = enabled && cpu.jit.available();
+#else
+    (void) enabled;
+#endif
+}
+
+// Headless runs that only look at memory can draw every nth frame, or none with 0,
+// the picture is the only thing that changes. renderFrame() draws the next frame
+// whatever the setting, for a screenshot or hash on demand.
+void NicoGB::renderEvery(unsigned frames) {
+    ppu.interval = frames;
+}
+
+void NicoGB::renderFrame() {
+    ppu.requested = true;
+}
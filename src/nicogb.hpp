@@ -1,14 +1,19 @@
 #pragma once
 
+#include <memory>
+
+#include "scheduler.hpp"
 #include "timer.hpp"
 #include "cartridge.hpp"
 #include "joypad.hpp"
 #include "memory.hpp"
 #include "ppu.hpp"
 #include "cpu.hpp"
+#include "state.hpp"
 
 class NicoGB {
     private:
+        Scheduler scheduler;
         Timer timer;
         Cartridge cartridge;
         Joypad joypad;
@@ -16,25 +21,52 @@ class NicoGB {
         PPU ppu;
         CPU cpu;
 
-        std::chrono::_V2::system_clock::time_point epoch;
-        std::chrono::_V2::system_clock::time_point now();
-        int64_t millis();
-        int64_t last;
+        uint64_t target;
+        uint64_t synced; // Cycle count at the last periodic .sav sync
+        void step(uint64_t end);
+
+        // Reused between calls, backup undoes a load that fails halfway
+        State state;
+        State backup;
+        void serialize(State& state);
+
+        // Run-ahead snapshot and the frame it shows
+        State snapshot;
+        std::vector<uint32_t> ahead;
+
+        NicoGB(NicoGB* from);
 
     public:
-        bool speed;
+        // T-cycles in one frame, 59.73 frames per second
+        static const uint64_t FRAME = 70224;
+        // T-cycles between periodic .sav syncs, 10 seconds
+        static const uint64_t SYNC = 10 * 4194304;
+
         bool& loaded;
         std::string& title;
+        std::string& serial;
         std::vector<uint32_t>& framebuffer;
 
         void init();
-        void load(std::string path);
-        void tick();
+        void load(std::string path, bool battery = true);
+        void runCycles(uint64_t cycles);
+        bool runFrame();
+        const std::vector<uint32_t>& runAhead(unsigned frames);
+        uint64_t cycles();
+        Registers registers();
+        void saveState(std::vector<uint8_t>& out, bool compress = false);
+        bool loadState(const std::vector<uint8_t>& in);
+        std::unique_ptr<NicoGB> fork();
         void keyDown(Key key);
         void keyUp(Key key);
         uint8_t serialDataRead();
         void serialDataWrite(uint8_t value);
         bool serialTransferRead();
         void serialTransferWrite(bool value);
+        const BlockCache::Stats& blockStats();
+        bool jitAvailable();
+        void useJit(bool enabled);
+        void renderEvery(unsigned frames);
+        void renderFrame();
         NicoGB();
 };
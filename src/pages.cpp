@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cstring>
+
+#include "pages.hpp"
+#include "state.hpp"
+
+Pages::Pages() {
+    bytes = 0;
+    mapped = false;
+}
+
+// Fresh zeroed pages in one block, each page keeps the block alive
+void Pages::allocate(size_t size) {
+    size_t count = (size + SIZE - 1) / SIZE;
+    std::shared_ptr<uint8_t> block(new uint8_t[count * SIZE](), std::default_delete<uint8_t[]>());
+    pages.resize(count);
+    for (size_t page = 0; page < count; ++page) {
+        pages[page] = std::shared_ptr<uint8_t>(block, block.get() + page * SIZE);
+    }
+    owned.assign(count, true);
+    bytes = size;
+    mapped = false;
+}
+
+// Pages over memory owned by keep, a file mapping written in place
+void Pages::map(uint8_t* data, size_t size, std::shared_ptr<void> keep) {
+    size_t count = (size + SIZE - 1) / SIZE;
+    pages.resize(count);
+    for (size_t page = 0; page < count; ++page) {
+        pages[page] = std::shared_ptr<uint8_t>(keep, data + page * SIZE);
+    }
+    owned.assign(count, true);
+    bytes = size;
+    mapped = true;
+}
+
+// Neither side may write a shared page in place any more. A file mapping
+// isn't shared, the fork starts from a copy and never writes the file.
+void Pages::share(Pages& from) {
+    if (from.mapped) {
+        allocate(from.bytes);
+        for (size_t page = 0; page < pages.size(); ++page) {
+            memcpy(pages[page].get(), from.pages[page].get(), SIZE);
+        }
+        return;
+    }
+    pages = from.pages;
+    bytes = from.bytes;
+    owned.assign(pages.size(), false);
+    from.owned.assign(pages.size(), false);
+}
+
+uint8_t* Pages::copy(size_t page) {
+    std::shared_ptr<uint8_t> fresh(new uint8_t[SIZE], std::default_delete<uint8_t[]>());
+    memcpy(fresh.get(), pages[page].get(), SIZE);
+    pages[page] = fresh;
+    owned[page] = true;
+    return fresh.get();
+}
+
+void Pages::serialize(State& state) {
+    state.check(bytes);
+    for (size_t page = 0; state.ok && page < pages.size(); ++page) {
+        size_t size = std::min(size_t(SIZE), bytes - page * SIZE);
+        state.bytes(state.loading ? write(page) : read(page), size);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class State;
+
+// RAM split into 256 byte pages, the granularity of the memory map. Forked
+// instances share pages until one of them writes, which copies just that page.
+// Only owned pages may be written in place or get a write map entry. Pages
+// over a file mapping stay with their instance, forks copy them.
+class Pages {
+    public:
+        static const size_t SIZE = 0x100;
+
+        uint8_t* read(size_t page) { return pages[page].get(); }
+        uint8_t* write(size_t page) { return owned[page] ? pages[page].get() : copy(page); }
+        bool isOwned(size_t page) { return owned[page]; }
+        uint8_t get(size_t address) { return read(address / SIZE)[address % SIZE]; }
+        void set(size_t address, uint8_t n) { write(address / SIZE)[address % SIZE] = n; }
+        size_t size() { return bytes; }
+        size_t count() { return pages.size(); }
+
+        void allocate(size_t size);
+        void map(uint8_t* data, size_t size, std::shared_ptr<void> keep);
+        void share(Pages& from);
+        void serialize(State& state);
+        Pages();
+
+    private:
+        std::vector<std::shared_ptr<uint8_t>> pages;
+        std::vector<bool> owned;
+        size_t bytes;
+        bool mapped;
+        uint8_t* copy(size_t page);
+};
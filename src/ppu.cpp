@@ -1,8 +1,15 @@
 #include <tuple>
 #include <algorithm>
+#include <cstring>
 
+#include "compositor.hpp"
 #include "memory.hpp"
+#include "scheduler.hpp"
 #include "ppu.hpp"
+#include "state.hpp"
+
+// M-cycles spent in each mode, 4 is the glitched OAM search after LCD on
+const int DURATION[5] = {51, 114, 20, 43, 19};
 
 PPU::PPU(Memory& memory) :
     memory(memory),
@@ -12,30 +19,116 @@ PPU::PPU(Memory& memory) :
     scx(memory.lcd.scx),
     ly(memory.lcd.ly),
     lyc(memory.lcd.lyc),
-    bgp(memory.lcd.bgp),
-    obp0(memory.lcd.obp0),
-    obp1(memory.lcd.obp1),
+    palettes(memory.lcd.palettes),
     wy(memory.lcd.wy),
     wx(memory.lcd.wx) {
-    framebuffer = std::vector<uint32_t>(160*144);
-    writebuffer = std::vector<uint32_t>(160*144);
     line = std::vector<uint8_t>(160);
-    init();
+    interval = 1;
 }
 
+// The buffers are allocated here or by the first line a fork draws
 void PPU::init() {
-    std::fill_n(framebuffer.begin(), 160*144, 0);
-    std::fill_n(writebuffer.begin(), 160*144, 0);
+    framebuffer.assign(160*144, 0);
+    writebuffer.assign(160*144, 0);
     std::fill_n(line.begin(), 160, 0);
     mode = 4;
     totalCycles = 0;
+    last = memory.scheduler.cycles;
+    enabled = false;
     interrupt = false;
     windowCounter = 0;
     clear = true;
+    frame = false;
+    requested = false;
+    drawing = true;
+    frames = 0;
+    memory.scheduler.schedule(Scheduler::LCD, last + 4);
+}
+
+// Every pixel is one of the four shades, stored as 2 bits instead of ARGB. Until the
+// LCD first draws over them pixels are 0, those get a bitmap of their own.
+// A fork's buffers are empty until it draws, all 0 as far as a state goes.
+static void shades(State& state, std::vector<uint32_t>& buffer) {
+    const size_t SIZE = 160*144;
+    uint8_t packed[SIZE / 4];
+    uint8_t blanks[SIZE / 8] = {};
+    bool blank = false;
+    bool none = buffer.empty();
+    if (!state.loading) {
+        for (size_t i = 0; i < SIZE; i += 4) {
+            uint8_t byte = 0;
+            for (int j = 0; j < 4; ++j) {
+                uint32_t pixel = none ? 0 : buffer[i + j];
+                int shade = 3 - 3 * (pixel == PALETTE[0]) - 2 * (pixel == PALETTE[1]) - (pixel == PALETTE[2]);
+                byte |= shade << (j * 2);
+                blank |= pixel == 0;
+            }
+            packed[i / 4] = byte;
+        }
+        for (size_t i = 0; blank && i < SIZE; ++i) {
+            blanks[i / 8] |= (none || buffer[i] == 0) << (i % 8);
+        }
+    }
+    state.value(blank);
+    state.bytes(packed, sizeof(packed));
+    if (blank) {
+        state.bytes(blanks, sizeof(blanks));
+    }
+    if (state.loading && state.ok) {
+        buffer.resize(SIZE);
+        for (size_t i = 0; i < SIZE; i += 4) {
+            for (int j = 0; j < 4; ++j) {
+                buffer[i + j] = PALETTE[(packed[i / 4] >> (j * 2)) & 0x3];
+            }
+        }
+        for (size_t i = 0; blank && i < SIZE; ++i) {
+            if (blanks[i / 8] >> (i % 8) & 1) buffer[i] = 0;
+        }
+    }
+}
+
+void PPU::serialize(State& state) {
+    state.value(totalCycles);
+    state.value(last);
+    state.value(enabled);
+    state.value(interrupt);
+    state.value(mode);
+    state.value(windowCounter);
+    state.value(clear);
+    state.value(frame);
+    shades(state, framebuffer);
+    shades(state, writebuffer);
+}
+
+// A fork picks up where from is, mid-frame included, but without the buffers.
+// Lines from drew before the fork stay with it, so the fork draws from the next
+// frame on, that one whatever the interval if this one was to be drawn.
+void PPU::share(PPU& from) {
+    totalCycles = from.totalCycles;
+    last = from.last;
+    enabled = from.enabled;
+    interrupt = from.interrupt;
+    mode = from.mode;
+    windowCounter = from.windowCounter;
+    clear = from.clear;
+    frame = from.frame;
+    interval = from.interval;
+    requested = from.requested;
+    drawing = from.drawing;
+    frames = from.frames;
+    if (drawing && enabled && ly < 144 && (ly > 0 || mode == 0)) {
+        drawing = false;
+        requested = true;
+    }
 }
 
 void PPU::update() {
+    Scheduler& scheduler = memory.scheduler;
+    int cycles = (scheduler.cycles - last) / 4;
+    last = scheduler.cycles;
+
     if ((lcdc & 0x80) == 0) {
+        enabled = false;
         totalCycles = 0;
         ly = 0;
         windowCounter = 0;
@@ -43,15 +136,38 @@ void PPU::update() {
         stat = (lyc == ly) ? (stat | 0x4) : (stat & ~0x4);
         if (clear) {
             clear = false;
-            std::fill_n(writebuffer.begin(), 160*144, getPalette(0)[0]);
-            std::fill_n(framebuffer.begin(), 160*144, getPalette(0)[0]);
+            std::fill(writebuffer.begin(), writebuffer.end(), PALETTE[0]);
+            std::fill(framebuffer.begin(), framebuffer.end(), PALETTE[0]);
         }
+        scheduler.cancel(Scheduler::LCD);
         return;
     }
     clear = true;
 
-    totalCycles++;
+    // Switched on by the LCDC write one cycle ago
+    if (!enabled) {
+        enabled = true;
+        cycles = 1;
+        startFrame();
+    }
 
+    while (cycles > 0) {
+        int n = std::min(cycles, DURATION[mode] - totalCycles);
+        totalCycles += n;
+        cycles -= n;
+        step();
+    }
+
+    scheduler.schedule(Scheduler::LCD, last + 4 * (DURATION[mode] - totalCycles));
+}
+
+void PPU::startFrame() {
+    ++frames;
+    drawing = requested || (interval > 0 && frames % interval == 0);
+    requested = false;
+}
+
+void PPU::step() {
     switch (mode) {
         case 2: // OAM Search
             if (totalCycles >= 20) {
@@ -66,10 +182,9 @@ void PPU::update() {
                 totalCycles -= 43;
                 mode = 0;
                 stat = (stat & 0xFC) | 0x00;
-                std::fill_n(line.begin(), 160, 0);
-                drawBackground();
-                drawWindow();
-                drawSprites();
+                if (drawing) {
+                    drawLine();
+                }
             }
             break;
 
@@ -83,7 +198,10 @@ void PPU::update() {
                 } else {
                     mode = 1;
                     stat = (stat & 0xFC) | 0x01;
-                    framebuffer.swap(writebuffer);
+                    if (drawing) {
+                        framebuffer.swap(writebuffer);
+                    }
+                    frame = true;
                     memory.interrupt(0x1);
                 }
             }
@@ -97,6 +215,7 @@ void PPU::update() {
                     ly = 0;
                     windowCounter = 0;
                     mode = 2;
+                    startFrame();
                     stat = (stat & 0xFC) | 0x02;
                 }
             }
@@ -123,69 +242,37 @@ void PPU::update() {
     }
 }
 
-std::vector<uint32_t> PPU::getPalette(uint8_t palette) {
-    const std::vector<uint32_t> PALETTE = {0xfffff6d3, 0xfff9a875, 0xffeb6b6f, 0xff7c3f58};
-    std::vector<uint32_t> col = {0, 0, 0, 0};
-    for (int i = 0; i <= 6; i += 2) {
-        switch ((palette >> i) & 0x3) {
-            case 0:
-                col[i/2] = PALETTE[0];
-                break;
-            case 1:
-                col[i/2] = PALETTE[1];
-                break;
-            case 2:
-                col[i/2] = PALETTE[2];
-                break;
-            case 3:
-                col[i/2] = PALETTE[3];
-                break;
-        }
+// Background and window leave color indices in line, shaded in one pass before the
+// sprites, which still need the indices for their priority
+void PPU::drawLine() {
+    if (writebuffer.empty()) {
+        framebuffer.resize(160*144);
+        writebuffer.resize(160*144);
     }
-    return col;
+    std::fill_n(line.begin(), 160, 0);
+    drawBackground();
+    drawWindow();
+    Compositor::shade(&writebuffer[ly * 160], line.data(), palettes[0], 160);
+    drawSprites();
 }
 
 void PPU::drawBackground() {
     if (!(lcdc & 0x1)) {
-        if (ly < 144) {
-            std::fill_n(writebuffer.begin() + ly * 160, 160, getPalette(bgp)[0]);
-        }
         return;
     }
     uint16_t tileSelect = ((lcdc & 0x8) >> 3) ? 0x9C00 : 0x9800;
-    uint16_t tileData = ((lcdc & 0x10) >> 4) ? 0x8000 : 0x9000;
-    std::vector<uint32_t> col = getPalette(bgp);
+    bool unsignedTiles = lcdc & 0x10; // 0x8000 based, else signed from 0x9000
 
+    // 21 tiles cover the line at any fine scroll
     uint8_t tileY = ((ly + scy) / 8) % 32;
+    uint8_t pixelY = (ly + scy) % 8;
+    const uint8_t* map = memory.tileMap(tileSelect, tileY);
+    uint8_t colors[21 * 8];
     for (int i = 0; i < 21; ++i) {
-        uint8_t tileX = (scx / 8 + i) % 32;
-
-        uint8_t tileNumber = memory.read(tileSelect + (tileY * 32) + tileX);
-        uint8_t pixelY = (ly + scy) % 8;
-
-        uint8_t byte1 = 0;
-        uint8_t byte2 = 0;
-        if (tileData == 0x8000) {
-            byte1 = memory.read(tileData + tileNumber * 16 + (pixelY * 2));
-            byte2 = memory.read(tileData + tileNumber * 16 + (pixelY * 2) + 1);
-        } else {
-            byte1 = memory.read(tileData + ((int8_t) (tileNumber) * 16) + (pixelY * 2));
-            byte2 = memory.read(tileData + ((int8_t) (tileNumber) * 16) + (pixelY * 2) + 1);
-        }
-
-        for (uint8_t pixelX = 0; pixelX < 8; ++pixelX) {
-            uint8_t bit1 = (byte1 >> (7 - pixelX)) & 0x1;
-            uint8_t bit2 = (byte2 >> (7 - pixelX)) & 0x1;
-            uint8_t color = (bit2 << 1) | bit1;
-            uint32_t pixel = col[color];
-
-            int X = i * 8 + pixelX - (scx % 8);
-            if (X >= 0 && ly < 144 && X < 160) {
-                writebuffer[ly * 160 + X] = pixel;
-                line[X] = color;
-            }
-        }
+        uint8_t tileNumber = map[(scx / 8 + i) % 32];
+        memcpy(colors + i * 8, memory.tileRow(unsignedTiles ? tileNumber : 256 + (int8_t) tileNumber, pixelY, false), 8);
     }
+    memcpy(line.data(), colors + scx % 8, 160);
 }
 
 void PPU::drawWindow() {
@@ -193,38 +280,21 @@ void PPU::drawWindow() {
         return;
     }
     uint16_t tileSelect = (((lcdc & 0x40) >> 6)) ? 0x9C00 : 0x9800;
-    uint16_t tileData = ((((lcdc & 0x10) >> 4)) ? 0x8000 : 0x9000);
-    std::vector<uint32_t> col = getPalette(bgp);
+    bool unsignedTiles = lcdc & 0x10;
 
     uint8_t tileY = windowCounter / 8;
     uint8_t pixelY = windowCounter % 8;
     windowCounter++;
+    const uint8_t* map = memory.tileMap(tileSelect, tileY);
+    uint8_t colors[21 * 8];
     for (int i = 0; i < 21; ++i) {
-        uint8_t tileNumber = memory.read(tileSelect + (tileY * 32) + i);
-
-        uint8_t byte1 = 0;
-        uint8_t byte2 = 0;
-        if (tileData == 0x8000) {
-            byte1 = memory.read(tileData + (tileNumber*16) + (pixelY * 2));
-            byte2 = memory.read(tileData + (tileNumber*16) + (pixelY * 2) + 1);
-        } else {
-            byte1 = memory.read(tileData + ((int8_t) (tileNumber) * 16) + (pixelY * 2));
-            byte2 = memory.read(tileData + ((int8_t) (tileNumber) * 16) + (pixelY * 2) + 1);
-        }
-
-        for (int pixelX = 0; pixelX < 8; ++pixelX) { // X
-            uint8_t bit1 = (byte1 >> (7 - pixelX)) & 0x1;
-            uint8_t bit2 = (byte2 >> (7 - pixelX)) & 0x1;
-            uint8_t color = (bit2 << 1) | bit1;
-            uint32_t pixel = col[color];
-
-            int X = i * 8 + pixelX + wx - 7;
-            if (X >= 0 && ly < 144 && X < 160) {
-                writebuffer[ly * 160 + X] = pixel;
-                line[X] = color;
-            }
-        }
+        uint8_t tileNumber = map[i];
+        memcpy(colors + i * 8, memory.tileRow(unsignedTiles ? tileNumber : 256 + (int8_t) tileNumber, pixelY, false), 8);
     }
+    // Starts up to 7 pixels left of the screen
+    int start = wx - 7;
+    int skip = std::max(0, -start);
+    memcpy(line.data() + start + skip, colors + skip, 160 - start - skip);
 }
 
 void PPU::drawSprites() {
@@ -232,30 +302,33 @@ void PPU::drawSprites() {
         return;
     }
     int size = ((lcdc & 0x4) >> 2) ? 16 : 8;
-    const uint16_t OAM = 0xFE00;
+    const uint8_t* oam = memory.objects();
 
+    // At most 10 per line, on the stack so drawing never allocates
     typedef std::tuple<int, int, int> SpriteTuple;
-    std::vector<SpriteTuple> sprites = std::vector<SpriteTuple>();
-    sprites.reserve(10);
+    SpriteTuple sprites[10];
+    int count = 0;
     for (int byte = 0; byte < 0x9F; byte += 4) {
-        int Y = memory.read(OAM+byte) - 16;
-        int X = memory.read(OAM+byte + 1) - 8;
+        int Y = oam[byte] - 16;
+        int X = oam[byte + 1] - 8;
 
         if (Y <= ly && Y > ly - size) {
-            sprites.push_back(std::make_tuple(byte, Y, X));
-            if (sprites.size() >= 10) {
+            sprites[count++] = std::make_tuple(byte, Y, X);
+            if (count >= 10) {
                 break;
             }
         }
     }
 
-    std::sort(sprites.begin(), sprites.end(),
-        [](const SpriteTuple& a, const SpriteTuple& b) {
-            return (std::get<2>(a) >= std::get<2>(b));
+    // Drawn right to left, at equal X the sprite first in OAM ends up on top
+    for (int k = 1; k < count; ++k) {
+        for (int j = k; j > 0 && std::get<2>(sprites[j]) >= std::get<2>(sprites[j - 1]); --j) {
+            std::swap(sprites[j], sprites[j - 1]);
         }
-    );
+    }
 
-    for (const auto &sprite : sprites) {
+    for (int k = 0; k < count; ++k) {
+        const SpriteTuple& sprite = sprites[k];
         int byte = std::get<0>(sprite);
         int Y = std::get<1>(sprite);
         int X = std::get<2>(sprite);
@@ -264,44 +337,24 @@ void PPU::drawSprites() {
             continue;
         }
 
-        uint8_t tileNumber = memory.read(OAM+byte+2);
+        uint8_t tileNumber = oam[byte + 2];
         if (size == 16) {
             tileNumber &= ~1;
         }
 
-        uint8_t attributes = memory.read(OAM+byte+3);
-        std::vector<uint32_t> col = getPalette((attributes & 0x10) ? obp1 : obp0);
+        uint8_t attributes = oam[byte + 3];
+        const uint32_t* col = palettes[(attributes & 0x10) ? 2 : 1];
         bool xFlip = attributes & 0x20;
         bool yFlip = attributes & 0x40;
         bool priority = attributes & 0x80;
 
-        int i = ly - Y;
-        uint8_t byte1 = memory.read(0x8000 + (tileNumber*16) + i * 2);
-        uint8_t byte2 = memory.read(0x8000 + (tileNumber*16) + i * 2 + 1);
-        if (yFlip) {
-            byte1 = memory.read(0x8000 + (tileNumber*16) + (size - 1 - i) * 2);
-            byte2 = memory.read(0x8000 + (tileNumber*16) + (size - 1 - i) * 2 + 1);
-        }
-
-        for (int j = 0; j < 8; ++j) {
-            int XX = X + j;
-            if (ly < 144 && XX < 160 && XX >= 0) {
-                if (priority && line[XX] > 0) {
-                    continue;
-                }
-                uint8_t bit1 = (byte1 >> (7 - j)) & 0x1;
-                uint8_t bit2 = (byte2 >> (7 - j)) & 0x1;
-                if (xFlip) {
-                    bit1 = (byte1 >> j) & 0x1;
-                    bit2 = (byte2 >> j) & 0x1;
-                }
-                uint8_t color = (bit2 << 1) | bit1;
-                uint32_t pixel = col[color];
+        // 8x16 sprites run on into the next tile
+        int i = yFlip ? size - 1 - (ly - Y) : ly - Y;
+        const uint8_t* row = memory.tileRow(tileNumber + i / 8, i % 8, xFlip);
 
-                if (color != 0) {
-                    writebuffer[ly * 160 + XX] = pixel;
-                }
-            }
-        }
+        // Clipped to the screen edges
+        int start = std::max(X, 0);
+        int end = std::min(X + 8, 160);
+        Compositor::sprite(&writebuffer[ly * 160 + start], row + (start - X), &line[start], col, priority, end - start);
     }
 }
@@ -3,17 +3,34 @@
 #include <cstdint>
 
 class Memory;
+class State;
+
+// The four shades of the screen as ARGB, lightest first
+const uint32_t PALETTE[4] = {0xfffff6d3, 0xfff9a875, 0xffeb6b6f, 0xff7c3f58};
 
 class PPU {
     public:
         Memory& memory;
         std::vector<uint32_t> framebuffer;
+        // Set on entering V-Blank, cleared by whoever consumes the frame
+        bool frame;
+        // Every interval-th frame is drawn, none when 0, and the next one whatever the
+        // interval once requested. Modes, LY and interrupts run the same either way.
+        unsigned interval;
+        bool requested;
+        bool drawing; // Decided as each frame starts, so frames are drawn whole
         void init();
         void update();
+        void serialize(State& state);
+        void share(PPU& from);
+        // Draws scanline ly into the back buffer, as at the end of pixel transfer
+        void drawLine();
         PPU(Memory& memory);
 
     private:
         int totalCycles;
+        uint64_t last;
+        bool enabled;
         bool interrupt;
         uint8_t& lcdc;
         uint8_t& stat;
@@ -21,21 +38,21 @@ class PPU {
         uint8_t& scx;
         uint8_t& ly;
         uint8_t& lyc;
-        uint8_t& bgp;
-        uint8_t& obp0;
-        uint8_t& obp1;
+        uint32_t (&palettes)[3][4];
         uint8_t& wy;
         uint8_t& wx;
 
         uint8_t mode;
         int windowCounter;
+        uint64_t frames;
         std::vector<uint32_t> writebuffer;
         std::vector<uint8_t> line;
         bool clear;
 
         void checkInterrupt(uint8_t mode);
+        void step();
+        void startFrame();
         void updateScanLine();
-        std::vector<uint32_t> getPalette(uint8_t palette);
         void drawBackground();
         void drawSprites();
         void drawWindow();
@@ -0,0 +1,152 @@
+#include <cstring>
+
+#include "rewind.hpp"
+#include "lz4.hpp"
+
+Rewind::Rewind(size_t capacity, unsigned interval) :
+    capacity(capacity), interval(interval ? interval : 1) {
+    clear();
+}
+
+void Rewind::clear() {
+    entries.clear();
+    current.clear();
+    used = 0;
+    pushed = 0;
+}
+
+size_t Rewind::frames() {
+    return entries.size();
+}
+
+size_t Rewind::bytes() {
+    return used + current.size();
+}
+
+size_t Rewind::cost(const Entry& entry) {
+    return entry.delta.size() + entry.key.size() + sizeof(Entry);
+}
+
+static void varint(std::vector<uint8_t>& out, size_t n) {
+    for (; n >= 0x80; n >>= 7) {
+        out.push_back(n | 0x80);
+    }
+    out.push_back(n);
+}
+
+static size_t varint(const uint8_t*& p) {
+    size_t n = 0;
+    for (int shift = 0; ; shift += 7) {
+        n |= (size_t) (*p & 0x7F) << shift;
+        if (!(*p++ & 0x80)) return n;
+    }
+}
+
+// Pairs of (unchanged bytes, changed bytes) counts, each followed by the changed bytes XORed
+void Rewind::encode(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to, std::vector<uint8_t>& delta) {
+    size_t i = 0;
+    size_t size = from.size();
+    while (i < size) {
+        size_t start = i;
+        // Most of a state is unchanged, skip it a word at a time
+        while (i + 8 <= size && memcmp(&from[i], &to[i], 8) == 0) i += 8;
+        while (i < size && from[i] == to[i]) ++i;
+        size_t same = i - start;
+        start = i;
+        while (i < size && from[i] != to[i]) ++i;
+        varint(delta, same);
+        varint(delta, i - start);
+        for (size_t j = start; j < i; ++j) {
+            delta.push_back(from[j] ^ to[j]);
+        }
+    }
+}
+
+// Turns the state of an entry's frame into the state of the frame before it
+void Rewind::apply(std::vector<uint8_t>& state, const Entry& entry) {
+    if (entry.whole) {
+        state = entry.delta;
+        return;
+    }
+    const uint8_t* p = entry.delta.data();
+    const uint8_t* end = p + entry.delta.size();
+    size_t i = 0;
+    while (p < end) {
+        i += varint(p);
+        for (size_t changed = varint(p); changed; --changed) {
+            state[i++] ^= *p++;
+        }
+    }
+}
+
+void Rewind::push(const std::vector<uint8_t>& state) {
+    Entry entry;
+    entry.whole = false;
+    entry.size = state.size();
+    if (!entries.empty()) {
+        if (current.size() == state.size()) {
+            encode(state, current, entry.delta);
+        } else {
+            entry.delta = current;
+            entry.whole = true;
+        }
+    }
+    if (pushed++ % interval == 0) {
+        LZ4::compress(state.data(), state.size(), entry.key);
+    }
+    // Counted by size, so don't keep the slack from growing them
+    entry.delta.shrink_to_fit();
+    entry.key.shrink_to_fit();
+    used += cost(entry);
+    entries.push_back(std::move(entry));
+    current = state;
+
+    // The new oldest frame no longer needs its way back
+    while (bytes() > capacity && entries.size() > 1) {
+        used -= cost(entries.front());
+        entries.pop_front();
+        used -= entries.front().delta.size();
+        entries.front().delta = std::vector<uint8_t>();
+    }
+}
+
+// Removes the newest frame and hands it out, the next pop gives the frame before
+bool Rewind::pop(std::vector<uint8_t>& state) {
+    if (entries.empty()) {
+        return false;
+    }
+    state = current;
+    used -= cost(entries.back());
+    if (entries.size() > 1) {
+        apply(current, entries.back());
+    } else {
+        current.clear();
+    }
+    entries.pop_back();
+    // The next push takes this frame's place, keyframes stay interval apart
+    --pushed;
+    return true;
+}
+
+// The frame age frames back, 0 being the newest, without removing anything
+bool Rewind::peek(size_t age, std::vector<uint8_t>& state) {
+    if (age >= entries.size()) {
+        return false;
+    }
+    size_t target = entries.size() - 1 - age;
+    size_t from = target;
+    while (from < entries.size() - 1 && entries[from].key.empty()) {
+        ++from;
+    }
+    if (entries[from].key.empty()) {
+        state = current;
+        from = entries.size() - 1;
+    } else {
+        state.resize(entries[from].size);
+        LZ4::decompress(entries[from].key.data(), entries[from].key.size(), state.data(), state.size());
+    }
+    for (; from > target; --from) {
+        apply(state, entries[from]);
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Ring of past save states under a byte budget. Only the newest state is kept
+// whole; every frame stores the XOR with the frame before it, run-length coded,
+// so stepping back one frame is one delta. Every interval frames a compressed
+// keyframe bounds the cost of reaching further back, and the oldest frames are
+// dropped once the budget is exceeded.
+class Rewind {
+    public:
+        size_t capacity;
+        unsigned interval;
+        void push(const std::vector<uint8_t>& state);
+        bool pop(std::vector<uint8_t>& state);
+        bool peek(size_t age, std::vector<uint8_t>& state);
+        size_t frames();
+        size_t bytes();
+        void clear();
+        Rewind(size_t capacity = 64 << 20, unsigned interval = 60);
+
+    private:
+        struct Entry {
+            std::vector<uint8_t> delta; // To the previous frame, empty for the oldest
+            bool whole;                 // delta is the previous state itself, sizes differed
+            std::vector<uint8_t> key;   // LZ4 of this frame, on keyframes only
+            size_t size;
+        };
+
+        std::deque<Entry> entries;
+        std::vector<uint8_t> current;
+        size_t used;
+        uint64_t pushed;
+
+        void encode(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to, std::vector<uint8_t>& delta);
+        void apply(std::vector<uint8_t>& state, const Entry& entry);
+        size_t cost(const Entry& entry);
+};
@@ -0,0 +1,78 @@
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+
+#include "rom.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define ROM_MMAP
+#endif
+
+// Process-wide, entries expire with the last instance using them
+static std::mutex cacheMutex;
+static std::map<std::string, std::weak_ptr<ROM>> cache;
+
+ROM::ROM() {
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+ROM::~ROM() {
+#ifdef ROM_MMAP
+    if (mapped) {
+        munmap(data, size);
+    }
+#endif
+}
+
+// Keyed by the path and the file's identity, so a ROM rebuilt in place is mapped
+// afresh. Hashing the contents instead would read every page on each load.
+std::shared_ptr<ROM> ROM::open(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG) {
+        return nullptr;
+    }
+    std::string key = path + '\0' + std::to_string(info.st_dev) + ':' + std::to_string(info.st_ino)
+        + ':' + std::to_string(info.st_size) + ':' + std::to_string(info.st_mtime);
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::shared_ptr<ROM> rom = cache[key].lock();
+    if (rom) {
+        return rom;
+    }
+    rom = std::make_shared<ROM>();
+    rom->size = info.st_size;
+#ifdef ROM_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0 && rom->size > 0) {
+        void* p = mmap(nullptr, rom->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            rom->data = (uint8_t*) p;
+            rom->mapped = true;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    if (!rom->mapped) {
+        std::ifstream file(path, std::ifstream::binary);
+        rom->buffer.resize(rom->size);
+        if (!file.read((char*) rom->buffer.data(), rom->size)) {
+            return nullptr;
+        }
+        rom->data = rom->buffer.data();
+    }
+
+    for (auto entry = cache.begin(); entry != cache.end();) {
+        entry = entry->second.expired() ? cache.erase(entry) : std::next(entry);
+    }
+    cache[key] = rom;
+    return rom;
+}
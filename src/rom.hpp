@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A ROM file mapped read-only. Instances loading the same unchanged file get the
+// same ROM, so hundreds of them share one mapping and the page cache behind it.
+class ROM {
+    public:
+        uint8_t* data;
+        size_t size;
+
+        static std::shared_ptr<ROM> open(const std::string& path);
+        ROM();
+        ~ROM();
+
+    private:
+        bool mapped;
+        std::vector<uint8_t> buffer; // Read into instead where mmap isn't available
+};
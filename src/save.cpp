@@ -0,0 +1,88 @@
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <set>
+
+#include "save.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SAVE_MMAP
+#endif
+
+// Paths with a primary Save, so two instances never write the same file
+static std::mutex openMutex;
+static std::set<std::string> opened;
+
+Save::Save() {
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    primary = false;
+}
+
+Save::~Save() {
+    sync(true);
+#ifdef SAVE_MMAP
+    if (mapped) {
+        munmap(data, size);
+    }
+#endif
+    if (primary) {
+        std::lock_guard<std::mutex> lock(openMutex);
+        opened.erase(path);
+    }
+}
+
+// A missing or short file is extended with zeros, like fresh SRAM
+std::shared_ptr<Save> Save::open(const std::string& path, size_t size) {
+    std::shared_ptr<Save> save = std::make_shared<Save>();
+    save->path = path;
+    save->size = size;
+    {
+        std::lock_guard<std::mutex> lock(openMutex);
+        save->primary = opened.insert(path).second;
+    }
+#ifdef SAVE_MMAP
+    int fd = save->primary ? ::open(path.c_str(), O_RDWR | O_CREAT, 0644) : -1;
+    struct stat info;
+    if (fd >= 0 && fstat(fd, &info) == 0 && (info.st_size >= (off_t) size || ftruncate(fd, size) == 0)) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            save->data = (uint8_t*) p;
+            save->mapped = true;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    if (!save->mapped) {
+        std::ifstream file(path, std::ifstream::binary);
+        save->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        save->buffer.resize(size);
+        save->data = save->buffer.data();
+    }
+    return save;
+}
+
+// Called when the game disables RAM, every few seconds and at exit, never per write
+void Save::sync(bool wait) {
+    if (!primary) {
+        return;
+    }
+#ifdef SAVE_MMAP
+    if (mapped) {
+        msync(data, size, wait ? MS_SYNC : MS_ASYNC);
+        return;
+    }
+#endif
+    std::ofstream file(path, std::ofstream::binary | std::ofstream::in | std::ofstream::out);
+    if (!file) {
+        file.open(path, std::ofstream::binary);
+    }
+    file.write((const char*) data, size);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Battery backed cartridge RAM kept in a .sav file, mapped so a write costs no
+// more than a store. sync() has the OS write changed pages back, the destructor
+// waits for it. A file already open in this process is copied instead, writes
+// to the copy are never saved.
+class Save {
+    public:
+        uint8_t* data;
+        size_t size;
+
+        static std::shared_ptr<Save> open(const std::string& path, size_t size);
+        void sync(bool wait);
+        Save();
+        ~Save();
+
+    private:
+        std::string path;
+        bool mapped;
+        bool primary;
+        std::vector<uint8_t> buffer; // Used instead of a mapping for copies and where mmap isn't available
+};
@@ -0,0 +1,45 @@
+#include "scheduler.hpp"
+#include "state.hpp"
+
+Scheduler::Scheduler() {
+    init();
+}
+
+void Scheduler::init() {
+    cycles = 0;
+    for (auto& d : deadline) {
+        d = UINT64_MAX;
+    }
+    next = UINT64_MAX;
+}
+
+void Scheduler::schedule(Event event, uint64_t cycle) {
+    deadline[event] = cycle;
+    update();
+}
+
+void Scheduler::cancel(Event event) {
+    schedule(event, UINT64_MAX);
+}
+
+bool Scheduler::due(Event event) {
+    return deadline[event] <= cycles;
+}
+
+// Only a handful of event sources, a linear scan beats a heap
+void Scheduler::update() {
+    next = deadline[0];
+    for (int i = 1; i < EVENTS; ++i) {
+        if (deadline[i] < next) {
+            next = deadline[i];
+        }
+    }
+}
+
+void Scheduler::serialize(State& state) {
+    state.value(cycles);
+    for (auto& d : deadline) {
+        state.value(d);
+    }
+    update();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+class State;
+
+class Scheduler {
+    public:
+        enum Event {
+            TIMER,
+            DMA,
+            LCD,
+            SERIAL,
+            EVENTS
+        };
+
+        uint64_t cycles;
+        uint64_t next;
+        void init();
+        void schedule(Event event, uint64_t cycle);
+        void cancel(Event event);
+        bool due(Event event);
+        void serialize(State& state);
+        Scheduler();
+
+    private:
+        uint64_t deadline[EVENTS];
+        void update();
+};
@@ -0,0 +1,102 @@
+#include <cstring>
+
+#include "state.hpp"
+
+State::State() {
+    start(false);
+}
+
+// Rewinds for another pass, keeping the buffer so repeated saves don't allocate
+void State::start(bool loading) {
+    this->loading = loading;
+    if (!loading) {
+        data.clear();
+    }
+    position = 0;
+    ok = true;
+}
+
+void State::integer(uint64_t& n, int size) {
+    if (!loading) {
+        for (int i = 0; i < size; ++i) {
+            data.push_back(n >> (i * 8));
+        }
+        return;
+    }
+    n = 0;
+    if (position + size > data.size()) {
+        ok = false;
+        return;
+    }
+    for (int i = 0; i < size; ++i) {
+        n |= (uint64_t) data[position++] << (i * 8);
+    }
+}
+
+void State::value(bool& n) {
+    uint64_t v = n;
+    integer(v, 1);
+    n = v;
+}
+
+void State::value(uint8_t& n) {
+    uint64_t v = n;
+    integer(v, 1);
+    n = v;
+}
+
+void State::value(uint16_t& n) {
+    uint64_t v = n;
+    integer(v, 2);
+    n = v;
+}
+
+void State::value(uint32_t& n) {
+    uint64_t v = n;
+    integer(v, 4);
+    n = v;
+}
+
+void State::value(uint64_t& n) {
+    integer(n, 8);
+}
+
+void State::value(int& n) {
+    uint64_t v = (uint32_t) n;
+    integer(v, 4);
+    n = (int32_t) v;
+}
+
+void State::value(long long& n) {
+    uint64_t v = n;
+    integer(v, 8);
+    n = v;
+}
+
+void State::bytes(uint8_t* p, size_t size) {
+    if (!loading) {
+        data.insert(data.end(), p, p + size);
+    } else if (position + size > data.size()) {
+        ok = false;
+    } else {
+        memcpy(p, &data[position], size);
+        position += size;
+    }
+}
+
+// The size goes first, loading into a buffer of another size fails
+void State::bytes(std::vector<uint8_t>& v) {
+    check(v.size());
+    if (ok) {
+        bytes(v.data(), v.size());
+    }
+}
+
+// Writes n, or fails the load unless the same n is read back
+void State::check(uint32_t n) {
+    uint32_t v = n;
+    value(v);
+    if (v != n) {
+        ok = false;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Save state stream. Every component has a single serialize() that goes over
+// its fields in a fixed order, writing them or reading them back depending on
+// loading, so the two directions cannot drift apart. Values are little-endian.
+class State {
+    public:
+        // "NGBS", bumped VERSION whenever a serialize() changes
+        static const uint32_t MAGIC = 0x5342474E;
+        static const uint16_t VERSION = 2;
+        static const uint16_t COMPRESSED = 0x1;
+
+        std::vector<uint8_t> data;
+        size_t position;
+        bool loading;
+        bool ok; // Cleared on a short read or a mismatch, the rest reads as zeros
+
+        void value(bool& n);
+        void value(uint8_t& n);
+        void value(uint16_t& n);
+        void value(uint32_t& n);
+        void value(uint64_t& n);
+        void value(int& n);
+        void value(long long& n);
+        void bytes(uint8_t* p, size_t size);
+        void bytes(std::vector<uint8_t>& v);
+        void check(uint32_t n);
+        void start(bool loading);
+        State();
+
+    private:
+        void integer(uint64_t& n, int size);
+};
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <cstring>
+
+#include "tiles.hpp"
+
+// The tiles of zeroed VRAM, fresh blocks in one allocation unless all are owned
+// already, so decoding during a frame never allocates
+void Tiles::clear() {
+    if (!std::all_of(owned, owned + BLOCKS, [](bool owned) { return owned; })) {
+        std::shared_ptr<Block> all(new Block[BLOCKS], std::default_delete<Block[]>());
+        for (int block = 0; block < BLOCKS; ++block) {
+            blocks[block] = std::shared_ptr<Block>(all, all.get() + block);
+            owned[block] = true;
+        }
+    }
+    for (int block = 0; block < BLOCKS; ++block) {
+        memset(blocks[block].get(), 0, sizeof(Block));
+    }
+}
+
+void Tiles::decode(uint16_t offset, uint8_t low, uint8_t high) {
+    Block* block = write(offset >> 8);
+    uint8_t* row = block->rows[(offset >> 4) & 0xF][(offset >> 1) & 0x7];
+    uint8_t* mirror = block->flipped[(offset >> 4) & 0xF][(offset >> 1) & 0x7];
+    for (int pixel = 0; pixel < 8; ++pixel) {
+        uint8_t color = (((high >> (7 - pixel)) & 0x1) << 1) | ((low >> (7 - pixel)) & 0x1);
+        row[pixel] = color;
+        mirror[7 - pixel] = color;
+    }
+}
+
+// Neither side may decode into a shared block in place any more
+void Tiles::share(Tiles& from) {
+    for (int block = 0; block < BLOCKS; ++block) {
+        blocks[block] = from.blocks[block];
+        owned[block] = false;
+        from.owned[block] = false;
+    }
+}
+
+Tiles::Block* Tiles::write(int block) {
+    if (!owned[block]) {
+        blocks[block] = std::make_shared<Block>(*blocks[block]);
+        owned[block] = true;
+    }
+    return blocks[block].get();
+}
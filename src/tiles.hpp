@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+// The 384 tiles at 0x8000-0x97FF with each 2bpp row expanded to one color index
+// per pixel, left to right. Memory::write keeps them in step with VRAM, which
+// changes far less often than tiles are drawn. Kept per 256 byte VRAM page, so
+// forks share them like the pages and copy a block on the first write to it.
+// None until clear() or share().
+class Tiles {
+    public:
+        static const int BLOCKS = 0x1800 / 0x100;
+
+        // The 16 tiles of one page
+        struct Block {
+            uint8_t rows[16][8][8];
+            uint8_t flipped[16][8][8]; // Right to left, for X-flipped sprites
+        };
+
+        const uint8_t* row(int tile, int y) { return blocks[tile >> 4]->rows[tile & 0xF][y]; }
+        const uint8_t* flipped(int tile, int y) { return blocks[tile >> 4]->flipped[tile & 0xF][y]; }
+
+        // offset is from 0x8000, low and high are the two bytes of that row
+        void decode(uint16_t offset, uint8_t low, uint8_t high);
+        void clear();
+        void share(Tiles& from);
+
+    private:
+        std::shared_ptr<Block> blocks[BLOCKS];
+        bool owned[BLOCKS] = {};
+        Block* write(int block);
+};
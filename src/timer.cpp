@@ -1,24 +1,155 @@
+#include <algorithm>
+
+#include "scheduler.hpp"
 #include "timer.hpp"
+#include "state.hpp"
+
+const int FREQ[4] = {9, 3, 5, 7};
 
-Timer::Timer() {
+Timer::Timer(Scheduler& scheduler) : scheduler(scheduler) {
     init();
 }
 
 void Timer::init() {
-    counter = 0;
-    divider = 0;
+    base = scheduler.cycles;
+    last = scheduler.cycles;
     tima = 0;
     tma = 0;
     tac = 0;
     reload = 0;
+    glitch = 0;
     oldEdge = 0;
+    interrupt = false;
+    schedule();
+}
+
+uint8_t Timer::read(uint16_t address) {
+    switch (address) {
+        case 0xFF04: return (scheduler.cycles - base) >> 8;
+        case 0xFF05: sync(); return tima;
+        case 0xFF06: return tma;
+        default:     return tac | 0xF8;
+    }
+}
+
+void Timer::write(uint16_t address, uint8_t n) {
+    sync();
+    switch (address) {
+        case 0xFF04: hold(); base = last; break;
+        case 0xFF05: tima = n; break;
+        case 0xFF06: tma = n; break;
+        default:     hold(); tac = n | 0xF8; break;
+    }
+    schedule();
+}
+
+bool Timer::update() {
+    sync();
+    schedule();
+    bool irq = interrupt;
+    interrupt = false;
+    return irq;
+}
+
+bool Timer::edge(uint64_t cycle) {
+    return (((cycle - base) >> FREQ[tac & 0x3]) & 1) && (tac & 0x4) != 0;
+}
+
+// Keep the edge of the last tick, a write may cause a falling edge on the next
+void Timer::hold() {
+    if (glitch != last + 4) {
+        oldEdge = edge(last);
+        glitch = last + 4;
+    }
+}
+
+// Add the falling edges up to cycle, stopping early on overflow
+void Timer::advance(uint64_t cycle) {
+    if (cycle <= last) {
+        return;
+    }
+    if ((tac & 0x4) == 0) {
+        last = cycle;
+        return;
+    }
+
+    uint64_t period = 2 << FREQ[tac & 0x3];
+    uint64_t edges = (cycle - base) / period - (last - base) / period;
+    if (edges >= 0x100u - tima) {
+        uint64_t first = last + period - (last - base) % period;
+        last = first + (0xFF - tima) * period;
+        tima = 0;
+        reload = last + 4;
+    } else {
+        tima += edges;
+        last = cycle;
+    }
 }
 
-bool Timer::currentEdge() {
-    const int freq[4] = {9, 3, 5, 7};
-    return (counter & (1 << freq[tac & 0x3])) && (tac & 0x4) != 0;
+void Timer::sync() {
+    uint64_t cycle = scheduler.cycles;
+    while (last < cycle) {
+        uint64_t stop = cycle;
+        if (glitch > last && glitch < stop) {
+            stop = glitch;
+        }
+        if (reload > last && reload < stop) {
+            stop = reload;
+        }
+        if (stop != glitch && stop != reload) {
+            advance(stop);
+            continue;
+        }
+
+        advance(stop - 4);
+        if (last < stop - 4) {
+            continue;
+        }
+        last = stop;
+
+        if (stop == reload) {
+            reload = 0;
+            tima = tma;
+            interrupt = true;
+        }
+
+        bool fallingEdge = (stop == glitch ? oldEdge : edge(stop - 4)) && !edge(stop);
+        if (fallingEdge) {
+            tima++;
+            if (tima == 0) {
+                reload = stop + 4;
+            }
+        }
+    }
+}
+
+// Only the next TMA reload, or a glitched edge after a write, needs an event
+void Timer::schedule() {
+    uint64_t next = UINT64_MAX;
+
+    if (reload > last) {
+        next = reload;
+    } else if (tac & 0x4) {
+        uint64_t period = 2 << FREQ[tac & 0x3];
+        uint64_t first = last + period - (last - base) % period;
+        next = first + (0xFF - tima) * period + 4;
+    }
+    if (glitch > last) {
+        next = std::min(next, glitch);
+    }
+
+    scheduler.schedule(Scheduler::TIMER, next);
 }
 
-bool Timer::fallingEdge() {
-    return !currentEdge() && oldEdge;
+// Everything is kept in absolute cycles, valid as long as the Scheduler is restored too
+void Timer::serialize(State& state) {
+    state.value(tima);
+    state.value(tma);
+    state.value(tac);
+    state.value(base);
+    state.value(last);
+    state.value(reload);
+    state.value(glitch);
+    state.value(oldEdge);
+    state.value(interrupt);
 }
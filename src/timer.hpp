@@ -2,24 +2,32 @@
 
 #include <cstdint>
 
+class Scheduler;
+class State;
+
 class Timer {
     public:
-        union {
-            struct {
-                uint8_t low;
-                uint8_t divider;
-            };
-            struct {
-                uint16_t counter;
-            };
-        };
         uint8_t tima;
         uint8_t tma;
         uint8_t tac;
-        uint8_t reload;
-        bool oldEdge;
-        bool currentEdge();
-        bool fallingEdge();
+        uint8_t read(uint16_t address);
+        void write(uint16_t address, uint8_t n);
+        bool update();
         void init();
-        Timer();
+        void serialize(State& state);
+        Timer(Scheduler& scheduler);
+
+    private:
+        Scheduler& scheduler;
+        uint64_t base;
+        uint64_t last;
+        uint64_t reload;
+        uint64_t glitch;
+        bool oldEdge;
+        bool interrupt;
+        bool edge(uint64_t cycle);
+        void hold();
+        void advance(uint64_t cycle);
+        void sync();
+        void schedule();
 };